@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2019 Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "decimator.hpp"
+
+#include <cmath>
+
+Decimator::Decimator(size_t factor, size_t channels) noexcept
+{
+  m_factor = (factor > 0) ? factor : 1;
+  m_channels = channels;
+  m_taps = (m_factor > 1) ? DECIMATOR_TAPS_PER_PHASE*m_factor + 1 : 1;
+
+  // Hamming-windowed sinc, cut off at 90% of the output Nyquist frequency.
+  const double cutoff = 0.45/static_cast<double>(m_factor);
+  const double centre = static_cast<double>(m_taps - 1)/2;
+  double sum{0};
+  m_coefficients.resize(m_taps);
+  for (size_t i = 0; i < m_taps; i++)
+  {
+    const double t = static_cast<double>(i) - centre;
+    const double sinc = (std::fabs(t) < 1e-9) ? 2*cutoff : std::sin(2*M_PI*cutoff*t)/(M_PI*t);
+    const double window = (m_taps > 1) ? 0.54 - 0.46*std::cos(2*M_PI*static_cast<double>(i)/static_cast<double>(m_taps - 1)) : 1.0;
+    m_coefficients[i] = sinc*window;
+    sum += m_coefficients[i];
+  }
+  for (size_t i = 0; i < m_taps; i++)
+    m_coefficients[i] /= sum; // unity gain at DC
+
+  // Every sample is stored twice so that the newest m_taps samples are
+  // always contiguous, whatever the write position.
+  m_history.assign(2*m_taps*m_channels, 0.0);
+}
+
+bool Decimator::push(const double* in, double* out) noexcept
+{
+  for (size_t c = 0; c < m_channels; c++)
+  {
+    double* history = &m_history[2*m_taps*c];
+    history[m_position] = in[c];
+    history[m_position + m_taps] = in[c];
+  }
+  m_position = (m_position + 1 < m_taps) ? m_position + 1 : 0;
+
+  if (++m_phase < m_factor) return false;
+  m_phase = 0;
+
+  for (size_t c = 0; c < m_channels; c++)
+  {
+    const double* window = &m_history[2*m_taps*c + m_position]; // oldest first
+    double value{0};
+    for (size_t i = 0; i < m_taps; i++)
+      value += m_coefficients[i]*window[i];
+    out[c] = value;
+  }
+  return true;
+}
+
+size_t Decimator::factor() const noexcept
+{
+  return m_factor;
+}
+
+size_t Decimator::taps() const noexcept
+{
+  return m_taps;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2019 Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DECIMATOR_
+#define DECIMATOR_
+
+#include <cstddef>
+#include <vector>
+
+#define DECIMATOR_TAPS_PER_PHASE 8
+
+/* Multichannel FIR decimator (anti-aliasing low-pass + downsampling by an
+ * integer factor). Only every factor-th output is computed, so the cost is
+ * that of a polyphase implementation: TAPS_PER_PHASE multiply-adds per
+ * input sample and channel. */
+class Decimator {
+ public:
+  Decimator() = delete;
+  Decimator(size_t, size_t) noexcept;
+  ~Decimator() = default;
+
+ public:
+  bool push(const double*, double*) noexcept;
+  size_t factor() const noexcept;
+  size_t taps() const noexcept;
+
+ private:
+  size_t m_factor{1};
+  size_t m_channels{1};
+  size_t m_taps{1};
+  size_t m_position{0};
+  size_t m_phase{0};
+  std::vector<double> m_coefficients{};
+  std::vector<double> m_history{};
+};
+
+#endif
@@ -16,6 +16,7 @@
  */
 
 #include "eeg-decoder.hpp"
+#include "latency-trace.hpp"
 #include "ring_span.hpp"
 
 #include <sstream>
@@ -23,11 +24,12 @@
 #include <string>
 #include <stdlib.h>
 
-EEGDecoder::EEGDecoder(nonstd::ring_span_lite::ring_span<double>** buffers, size_t channels, size_t len) noexcept
+EEGDecoder::EEGDecoder(nonstd::ring_span_lite::ring_span<double>** buffers, size_t channels, size_t len, size_t decimation) noexcept
 {
   m_buffers = buffers;
   buffer_len = len;
-  channels_no = channels;
+  channels_no = (channels > CHANNEL_TOTAL) ? CHANNEL_TOTAL : channels;
+  if(decimation > 1) m_decimator.reset(new Decimator(decimation, channels_no));
   //std::vector<std::vector<double>> vectors(CHANNEL_NO, std::vector<double>(buffer_len));
   //outputVectors = &vectors;
 }
@@ -70,8 +72,8 @@ size_t EEGDecoder::decode(const uint8_t *buffer, const size_t size) noexcept {
 	    //if(abs(sample - internal_sample_counter) > 5) std::cout << "sample difference!" << std::endl;
 	    
 	    offset +=2;
-	    internal_sample_counter++;
 	    
+	    double values[CHANNEL_TOTAL];
 	    for(size_t i = 0; i < channels_no; i++)
 	    {
 			unsigned char byte0 = buffer[offset + 0];
@@ -87,8 +89,20 @@ size_t EEGDecoder::decode(const uint8_t *buffer, const size_t size) noexcept {
 	        //std::cout << "value channel  " << i << ": " << translateValue(value) << " mV" << std::endl;
 			offset += 3;
 			
+			values[i] = translateValue(value);
+		}
+		
+		// Only every n-th (filtered) sample reaches the buffers when decimating.
+		if(m_decimator && !m_decimator->push(values, values)) continue;
+		internal_sample_counter++;
+		
+		{
+			// One lock per sample rather than per channel.
+			LatencyTrace::TimePoint waitStart = LatencyTrace::now();
 			std::lock_guard<std::mutex> lck(m_bufferMutex);
-			m_buffers[i]->push_front(translateValue(value));
+			LatencyTrace::record(LatencyTrace::DECODE_LOCK_WAIT, waitStart);
+			for(size_t i = 0; i < channels_no; i++)
+				m_buffers[i]->push_front(values[i]);
 		}
 		
 		if(!data_ready && internal_sample_counter > buffer_len) //AFTER filling last values
@@ -150,7 +164,9 @@ std::vector<std::vector<double>>* EEGDecoder::readData() noexcept
 
 void EEGDecoder::readData(double** arr) noexcept
 {
+	LatencyTrace::TimePoint waitStart = LatencyTrace::now();
 	std::lock_guard<std::mutex> lck(m_bufferMutex);
+	LatencyTrace::record(LatencyTrace::READ_LOCK_WAIT, waitStart);
 	for(size_t i = 0; i < channels_no; i++)
 	{
 	  std::copy(m_buffers[i]->begin(), m_buffers[i]->end(), arr[i]);
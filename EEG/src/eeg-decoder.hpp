@@ -20,8 +20,10 @@
 
 #include "opendlv-standard-message-set.hpp"
 #include "ring_span.hpp"
+#include "decimator.hpp"
 
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <sstream>
 #include <vector>
@@ -54,9 +56,13 @@ class EEGDecoder {
  
  uint16_t valuesPerPacket{8};
 
+ private:
+  EEGDecoder(const EEGDecoder &) = delete;
+  EEGDecoder &operator=(const EEGDecoder &) = delete;
+
  public:
   EEGDecoder() = delete;
-  EEGDecoder(nonstd::ring_span_lite::ring_span<double>**, size_t, size_t) noexcept;
+  EEGDecoder(nonstd::ring_span_lite::ring_span<double>**, size_t, size_t, size_t decimation = 1) noexcept;
   ~EEGDecoder() = default;
 
  public:
@@ -82,7 +88,8 @@ class EEGDecoder {
   nonstd::ring_span_lite::ring_span<double>** m_buffers = nullptr;
   //int32_t* outputs[CHANNEL_NO] = nullptr;
   //uint16_t received{0};
-  uint8_t internal_sample_counter{0};
+  size_t internal_sample_counter{0};
+  std::unique_ptr<Decimator> m_decimator{nullptr};
 
  private:
   mutable std::mutex m_dataMutex{};
@@ -16,6 +16,8 @@
  */
 
 #include "eeg.hpp"
+#include "latency-trace.hpp"
+#include "realtime.hpp"
 
 //template< typename T, class Popper>
 //inline std::ostream & operator<<( std::ostream & os, ::nonstd::ring_span<T, Popper> const & rs )
@@ -23,7 +25,7 @@
 //    os << "[ring_span: "; std::copy( rs.begin(), rs.end(), std::ostream_iterator<T>(os, ", ") ); return os << "]";
 //}
 
-EEG::EEG(const std::string &device, const size_t channels, const size_t bins) noexcept {
+EEG::EEG(const std::string &device, const size_t channels, const size_t bins, const size_t decimation) noexcept {
   constexpr const uint32_t BAUDRATE{115200};
   constexpr const uint32_t TIMEOUT{500};
   
@@ -36,7 +38,7 @@ EEG::EEG(const std::string &device, const size_t channels, const size_t bins) no
 	buffers[i] = new nonstd::ring_span_lite::ring_span<double>(value_array[i], value_array[i] + bins, value_array[i], bins);
   }
 
-  m_decoder = new EEGDecoder(buffers, channels, bins);
+  m_decoder = new EEGDecoder(buffers, channels, bins, decimation);
   
   try {
     m_eegDevice.reset(new serial::Serial(device, BAUDRATE, serial::Timeout::simpleTimeout(TIMEOUT)));
@@ -44,15 +46,24 @@ EEG::EEG(const std::string &device, const size_t channels, const size_t bins) no
       m_eegDevice->setDTR(false);
       m_readingBytesFromDeviceThread.reset(new std::thread([&eegDevice = m_eegDevice, &decoder = *m_decoder](){
 		const uint16_t BUFFER_SIZE{2048};
-		uint8_t *data = new uint8_t[BUFFER_SIZE];
+		uint8_t *data = new uint8_t[BUFFER_SIZE]();
+		prefaultStack();
 		size_t size{0};
 		while (eegDevice->isOpen()) {
 		  std::this_thread::sleep_for(std::chrono::milliseconds(10));
 		  if (eegDevice->waitReadable()) {
-			size_t bytesAvailable{eegDevice->available()};
-			size_t bytesRead = eegDevice->read(data+size, ((BUFFER_SIZE - size) < bytesAvailable) ? (BUFFER_SIZE - size) : bytesAvailable);
+			size_t bytesRead{0};
+			{
+			  LatencySpan span(LatencyTrace::SERIAL_READ);
+			  size_t bytesAvailable{eegDevice->available()};
+			  bytesRead = eegDevice->read(data+size, ((BUFFER_SIZE - size) < bytesAvailable) ? (BUFFER_SIZE - size) : bytesAvailable);
+			}
 			size += bytesRead;
-			size_t consumed = decoder.decode(data, size);
+			size_t consumed{0};
+			{
+			  LatencySpan span(LatencyTrace::DECODE);
+			  consumed = decoder.decode(data, size);
+			}
 			for (size_t i{0}; (0 < consumed) && (i < (size - consumed)); i++) {
 			  data[i] = data[i + consumed];
 			}
@@ -91,6 +102,10 @@ bool EEG::isOpen() const noexcept {
   return (m_eegDevice) && m_eegDevice->isOpen();
 }
 
+std::thread::native_handle_type EEG::readerHandle() const noexcept {
+  return m_readingBytesFromDeviceThread->native_handle();
+}
+
 bool EEG::isInitialized() const noexcept {
   return m_decoder->getStatus();
 }
@@ -108,6 +123,32 @@ void EEG::start() noexcept {
   }
 }
 
+/* Cyton sample rates, indexed by the code of the '~' command. */
+static const uint32_t CYTON_RATES[7] = {16000, 8000, 4000, 2000, 1000, 500, 250};
+
+bool EEG::isSupportedRate(uint32_t rate) noexcept {
+  for (uint32_t supported : CYTON_RATES)
+  {
+    if (supported == rate) return true;
+  }
+  return false;
+}
+
+bool EEG::setSampleRate(uint32_t rate) const noexcept {
+  /* Cyton sample rate command: '~' followed by the rate code. Must be
+   * sent while the board is not streaming. */
+  for (uint8_t code = 0; code < 7; code++)
+  {
+    if (CYTON_RATES[code] == rate)
+    {
+      const std::vector<uint8_t> COMMAND_RATE{'~', static_cast<uint8_t>('0' + code)};
+      m_eegDevice->write(COMMAND_RATE);
+      return true;
+    }
+  }
+  return false;
+}
+
 void EEG::stop() const noexcept {
   const std::vector<uint8_t> COMMAND_STOP{'s'};
   m_eegDevice->write(COMMAND_STOP); 
@@ -123,6 +164,7 @@ std::vector<std::vector<double>>* EEG::readData()
 void EEG::readData(double** arr)
 {
 	if(!m_decoder->dataReady()) throw "Data not ready.";
-	else m_decoder->readData(arr);
+	LatencySpan span(LatencyTrace::READ_DATA);
+	m_decoder->readData(arr);
 }
 
@@ -35,7 +35,7 @@ class EEG {
   EEG &operator=(EEG &&) = delete;
 
  public:
-  EEG(const std::string &device, const size_t, const size_t) noexcept;
+  EEG(const std::string &device, const size_t, const size_t, const size_t decimation = 1) noexcept;
   ~EEG();
 
  public:
@@ -44,8 +44,11 @@ class EEG {
   bool dataReady() const noexcept;
   void start() noexcept;
   void stop() const noexcept;
+  bool setSampleRate(uint32_t) const noexcept;
+  static bool isSupportedRate(uint32_t) noexcept;
   std::vector<std::vector<double>>* readData();
   void readData(double**);
+  std::thread::native_handle_type readerHandle() const noexcept;
 
  private:
   std::unique_ptr<serial::Serial> m_eegDevice{nullptr};
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2019 Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "latency-trace.hpp"
+
+#include <iomanip>
+#include <sstream>
+
+static LatencyHistogram histograms[LatencyTrace::STAGE_TOTAL];
+
+size_t LatencyHistogram::bucketOf(uint64_t value) noexcept
+{
+  if (value < (1ULL << (HISTOGRAM_SUB_BITS + 1))) return static_cast<size_t>(value);
+
+  int msb = 63 - __builtin_clzll(value);
+  if (msb > HISTOGRAM_MAX_BIT)
+  {
+    msb = HISTOGRAM_MAX_BIT;
+    value = (1ULL << (HISTOGRAM_MAX_BIT + 1)) - 1;
+  }
+  const uint64_t sub = (value >> (msb - HISTOGRAM_SUB_BITS)) - (1ULL << HISTOGRAM_SUB_BITS);
+  return (static_cast<size_t>(msb - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS) + static_cast<size_t>(sub);
+}
+
+uint64_t LatencyHistogram::bucketTop(size_t bucket) noexcept
+{
+  if (bucket < (1U << (HISTOGRAM_SUB_BITS + 1))) return bucket;
+
+  const int msb = static_cast<int>(bucket >> HISTOGRAM_SUB_BITS) + HISTOGRAM_SUB_BITS - 1;
+  const uint64_t mantissa = (bucket & ((1U << HISTOGRAM_SUB_BITS) - 1)) + (1ULL << HISTOGRAM_SUB_BITS);
+  return ((mantissa + 1) << (msb - HISTOGRAM_SUB_BITS)) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value) noexcept
+{
+  m_counts[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+  m_total.fetch_add(1, std::memory_order_relaxed);
+  m_sum.fetch_add(value, std::memory_order_relaxed);
+
+  uint64_t previous = m_max.load(std::memory_order_relaxed);
+  while (value > previous && !m_max.compare_exchange_weak(previous, value, std::memory_order_relaxed)) {}
+}
+
+void LatencyHistogram::reset() noexcept
+{
+  for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+    m_counts[i].store(0, std::memory_order_relaxed);
+  m_total.store(0, std::memory_order_relaxed);
+  m_sum.store(0, std::memory_order_relaxed);
+  m_max.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::count() const noexcept
+{
+  return m_total.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::max() const noexcept
+{
+  return m_max.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::mean() const noexcept
+{
+  const uint64_t total = count();
+  if (0 == total) return 0.0;
+  return static_cast<double>(m_sum.load(std::memory_order_relaxed))/static_cast<double>(total);
+}
+
+uint64_t LatencyHistogram::percentile(double p) const noexcept
+{
+  /* Counts are read without a snapshot; while recording continues the
+   * result is approximate, which is fine for diagnostics. */
+  uint64_t counts[HISTOGRAM_BUCKETS];
+  uint64_t total{0};
+  for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+  {
+    counts[i] = m_counts[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+  if (0 == total) return 0;
+
+  const uint64_t rank = static_cast<uint64_t>(p/100.0*static_cast<double>(total - 1)) + 1;
+  uint64_t seen{0};
+  for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+  {
+    seen += counts[i];
+    if (seen >= rank) return bucketTop(i);
+  }
+  return max();
+}
+
+void LatencyTrace::record(Stage stage, const TimePoint &start) noexcept
+{
+  const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now() - start).count();
+  histograms[stage].record(static_cast<uint64_t>(elapsed));
+}
+
+LatencyHistogram &LatencyTrace::histogram(Stage stage) noexcept
+{
+  return histograms[stage];
+}
+
+const char* LatencyTrace::name(Stage stage) noexcept
+{
+  switch (stage)
+  {
+    case SERIAL_READ:      return "serial read";
+    case DECODE:           return "decode";
+    case DECODE_LOCK_WAIT: return "decode lock wait";
+    case READ_LOCK_WAIT:   return "read lock wait";
+    case READ_DATA:        return "read data";
+    case DETECT:           return "detect";
+    case PUBLISH:          return "publish";
+    default:               return "unknown";
+  }
+}
+
+std::string LatencyTrace::report()
+{
+  std::stringstream out;
+  out << std::left << std::setw(18) << "stage (us)" << std::right
+      << std::setw(10) << "count" << std::setw(10) << "mean" << std::setw(10) << "p50"
+      << std::setw(10) << "p90" << std::setw(10) << "p99" << std::setw(10) << "p99.9" << std::setw(10) << "max" << std::endl;
+  out << std::fixed << std::setprecision(1);
+  for (int s = 0; s < STAGE_TOTAL; s++)
+  {
+    const LatencyHistogram &h = histograms[s];
+    out << std::left << std::setw(18) << name(static_cast<Stage>(s)) << std::right
+        << std::setw(10) << h.count()
+        << std::setw(10) << h.mean()/1e3
+        << std::setw(10) << static_cast<double>(h.percentile(50))/1e3
+        << std::setw(10) << static_cast<double>(h.percentile(90))/1e3
+        << std::setw(10) << static_cast<double>(h.percentile(99))/1e3
+        << std::setw(10) << static_cast<double>(h.percentile(99.9))/1e3
+        << std::setw(10) << static_cast<double>(h.max())/1e3 << std::endl;
+  }
+  return out.str();
+}
+
+void LatencyTrace::reset() noexcept
+{
+  for (int s = 0; s < STAGE_TOTAL; s++)
+    histograms[s].reset();
+}
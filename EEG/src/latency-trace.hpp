@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2019 Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LATENCY_TRACE
+#define LATENCY_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/* Log-linear buckets as in HdrHistogram: 16 sub-buckets per power of two
+ * (about 6% resolution) from 1 ns up to ~18 minutes. */
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_MAX_BIT 40
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BIT - HISTOGRAM_SUB_BITS + 2) << HISTOGRAM_SUB_BITS)
+
+class LatencyHistogram {
+ public:
+  LatencyHistogram() = default;
+  ~LatencyHistogram() = default;
+
+ private:
+  LatencyHistogram(const LatencyHistogram &) = delete;
+  LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+ public:
+  void record(uint64_t) noexcept;
+  void reset() noexcept;
+  uint64_t count() const noexcept;
+  uint64_t max() const noexcept;
+  double mean() const noexcept;
+  uint64_t percentile(double) const noexcept;
+
+ private:
+  static size_t bucketOf(uint64_t) noexcept;
+  static uint64_t bucketTop(size_t) noexcept;
+
+ private:
+  std::atomic<uint64_t> m_counts[HISTOGRAM_BUCKETS]{};
+  std::atomic<uint64_t> m_total{0};
+  std::atomic<uint64_t> m_sum{0};
+  std::atomic<uint64_t> m_max{0};
+};
+
+/* Always-on per-stage latency tracing. Each stage is recorded by a single
+ * thread (serial reader or main loop), so recording is a couple of relaxed
+ * atomic increments; reporting may run concurrently from any thread. */
+class LatencyTrace {
+ public:
+  enum Stage {
+    SERIAL_READ = 0,
+    DECODE,
+    DECODE_LOCK_WAIT,
+    READ_LOCK_WAIT,
+    READ_DATA,
+    DETECT,
+    PUBLISH,
+    STAGE_TOTAL,
+  };
+
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+ public:
+  static TimePoint now() noexcept { return std::chrono::steady_clock::now(); }
+  static void record(Stage, const TimePoint &) noexcept;
+  static LatencyHistogram &histogram(Stage) noexcept;
+  static const char* name(Stage) noexcept;
+  static std::string report();
+  static void reset() noexcept;
+};
+
+/* Records the lifetime of the object into the stage histogram. */
+class LatencySpan {
+ public:
+  explicit LatencySpan(LatencyTrace::Stage stage) noexcept : m_stage(stage), m_start(LatencyTrace::now()) {}
+  ~LatencySpan() { LatencyTrace::record(m_stage, m_start); }
+
+ private:
+  LatencySpan(const LatencySpan &) = delete;
+  LatencySpan &operator=(const LatencySpan &) = delete;
+
+ private:
+  LatencyTrace::Stage m_stage;
+  LatencyTrace::TimePoint m_start;
+};
+
+#endif
@@ -20,8 +20,22 @@
 #include "opendlv-standard-message-set.hpp"
 #include "eeg.hpp"
 #include "p300-detector.hpp"
+#include "latency-trace.hpp"
+#include "realtime.hpp"
 
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
 #include <iostream>
+#include <sstream>
+#include <string>
+
+static std::atomic<bool> traceRequested{false};
+
+static void onTraceSignal(int) {
+  traceRequested = true;
+}
 
 int32_t main(int32_t argc, char **argv) {
   int32_t retCode{1};
@@ -37,6 +51,16 @@ int32_t main(int32_t argc, char **argv) {
     std::cerr << "         --device: serial port where the dongle is attached" << std::endl;
     std::cerr << "         --bins: number of bins (measurements in a buffer) for FFT" << std::endl;
     std::cerr << "         --freq: how often the value is returned (ms)" << std::endl;
+    std::cerr << "         --rate: (optional) board sample rate in Hz: 250 (default), 500, 1000, 2000, 4000, 8000 or 16000;" << std::endl;
+    std::cerr << "                 above 250 Hz the Cyton cannot send every sample over the 115200 baud dongle" << std::endl;
+    std::cerr << "         --analysis: (optional) rate in Hz, at most --rate, the signal is decimated to before detection; --bins counts samples at this rate" << std::endl;
+    std::cerr << "         --weights: (optional) comma-separated weight per channel, 0 masks a channel" << std::endl;
+    std::cerr << "         --railing: (optional) peak-to-peak limit above which a channel is skipped until it recovers" << std::endl;
+    std::cerr << "         --trace: (optional) seconds between latency reports sent as LogMessage; kill -USR1 prints one" << std::endl;
+    std::cerr << "         --readercpu, --detectorcpu: (optional) pin the serial reader / detector thread to a core" << std::endl;
+    std::cerr << "         --readerprio, --detectorprio: (optional) SCHED_FIFO priority (1-99) of the reader / detector thread" << std::endl;
+    std::cerr << "         --mlock: (optional) lock all memory and pre-fault buffers before streaming" << std::endl;
+    std::cerr << "         Channels can be masked at runtime with SwitchStateRequest (senderStamp = channel, state = 0/1)." << std::endl;
     std::cerr << "Example: " << argv[0] << " --cid=111 --device=/dev/ttyUSB0 --bins=128 --channels=3 --freq=50 --verbose" << std::endl;
   }
   else {
@@ -45,6 +69,29 @@ int32_t main(int32_t argc, char **argv) {
     const size_t BINS{stoi(commandlineArguments["bins"])};
     const size_t CHANNELS{stoi(commandlineArguments["channels"])};
     const int FREQ{stoi(commandlineArguments["freq"])};
+    const size_t RATE{(commandlineArguments.count("rate") != 0) ? static_cast<size_t>(std::stoi(commandlineArguments["rate"])) : SAMPLE_RATE};
+    const size_t ANALYSIS_RATE{(commandlineArguments.count("analysis") != 0) ? static_cast<size_t>(std::stoi(commandlineArguments["analysis"])) : RATE};
+    const size_t DECIMATION{(ANALYSIS_RATE > 0 && ANALYSIS_RATE < RATE) ? RATE/ANALYSIS_RATE : 1};
+    const int TRACE{(commandlineArguments.count("trace") != 0) ? std::stoi(commandlineArguments["trace"]) : 0};
+    const int READER_CPU{(commandlineArguments.count("readercpu") != 0) ? std::stoi(commandlineArguments["readercpu"]) : -1};
+    const int READER_PRIO{(commandlineArguments.count("readerprio") != 0) ? std::stoi(commandlineArguments["readerprio"]) : 0};
+    const int DETECTOR_CPU{(commandlineArguments.count("detectorcpu") != 0) ? std::stoi(commandlineArguments["detectorcpu"]) : -1};
+    const int DETECTOR_PRIO{(commandlineArguments.count("detectorprio") != 0) ? std::stoi(commandlineArguments["detectorprio"]) : 0};
+    const bool MLOCK{commandlineArguments.count("mlock") != 0};
+    const double RAILING{(commandlineArguments.count("railing") != 0) ? std::stod(commandlineArguments["railing"]) : 0.0};
+
+    if(!EEG::isSupportedRate(static_cast<uint32_t>(RATE)))
+    {
+      std::cerr << argv[0] << ": --rate=" << commandlineArguments["rate"] << " is not a Cyton sample rate (250, 500, 1000, 2000, 4000, 8000 or 16000 Hz)." << std::endl;
+      return retCode;
+    }
+    if(ANALYSIS_RATE == 0 || ANALYSIS_RATE > RATE)
+    {
+      std::cerr << argv[0] << ": --analysis=" << commandlineArguments["analysis"] << " must be between 1 and the sample rate of " << RATE << " Hz." << std::endl;
+      return retCode;
+    }
+    if(RATE > SAMPLE_RATE)
+      std::cerr << "[opendlv-eeg-usb]: " << RATE << " Hz is more than the serial dongle can carry; the board will drop samples." << std::endl;
     
     /*TEST*/
     /*
@@ -67,18 +114,63 @@ int32_t main(int32_t argc, char **argv) {
     * */
     /*/TEST*/
     
+    /* Locked before any buffer is allocated so that every later allocation
+     * is faulted in and stays resident (MCL_FUTURE). */
+    if(MLOCK && !lockMemory())
+      std::cerr << "[opendlv-eeg-usb]: mlockall failed: " << std::strerror(errno) << std::endl;
+    
     std::cout << "Waiting for initialization signal...";
     std::this_thread::sleep_for(std::chrono::milliseconds(500));
  
+    if(RATE % (RATE/DECIMATION) != 0 || RATE/DECIMATION != ANALYSIS_RATE)
+      std::cerr << "[opendlv-eeg-usb]: " << RATE << " Hz is not a multiple of " << ANALYSIS_RATE << " Hz, analysing at " << RATE/DECIMATION << " Hz." << std::endl;
+    
     double* eegArray[CHANNELS];
     for (size_t i = 0; i < CHANNELS; i++){
-      eegArray[i] = new double [BINS];
+      eegArray[i] = new double [BINS]();
+    }
+    EEG eeg(DEVICE, CHANNELS, BINS, DECIMATION);
+    P300Detector p300(eegArray, CHANNELS, BINS, RATE/DECIMATION);
+    
+    if(MLOCK)
+    {
+      // Touch the detector's stack and FFT buffers once before streaming.
+      prefaultStack();
+      p300.detect();
+    }
+    
+    if (commandlineArguments.count("weights") != 0) {
+      std::stringstream weights{commandlineArguments["weights"]};
+      std::string weight;
+      for (size_t i = 0; (i < CHANNELS) && std::getline(weights, weight, ','); i++) {
+        p300.setChannelWeight(i, std::stod(weight));
+      }
     }
-    EEG eeg(DEVICE, CHANNELS, BINS);
-    P300Detector p300(eegArray, CHANNELS, BINS);
     
     if (eeg.isOpen()) {
       cluon::OD4Session od4{static_cast<uint16_t>(std::stoi(commandlineArguments["cid"]))};
+      
+      auto onChannelRequest = [&p300, &VERBOSE](cluon::data::Envelope &&env){
+        const size_t channel = static_cast<size_t>(env.senderStamp());
+        opendlv::proxy::SwitchStateRequest request = cluon::extractMessage<opendlv::proxy::SwitchStateRequest>(std::move(env));
+        p300.setChannelActive(channel, request.state() != 0);
+        if(VERBOSE)
+          std::cout << "channel " << channel << (request.state() != 0 ? " enabled" : " masked") << std::endl;
+      };
+      od4.dataTrigger(opendlv::proxy::SwitchStateRequest::ID(), onChannelRequest);
+      
+      if(READER_CPU >= 0 && !setThreadAffinity(eeg.readerHandle(), READER_CPU))
+        std::cerr << "[opendlv-eeg-usb]: Failed to pin reader to cpu " << READER_CPU << ": " << std::strerror(errno) << std::endl;
+      if(READER_PRIO > 0 && !setThreadPriority(eeg.readerHandle(), READER_PRIO))
+        std::cerr << "[opendlv-eeg-usb]: Failed to set reader priority " << READER_PRIO << ": " << std::strerror(errno) << std::endl;
+      if(DETECTOR_CPU >= 0 && !setThreadAffinity(pthread_self(), DETECTOR_CPU))
+        std::cerr << "[opendlv-eeg-usb]: Failed to pin detector to cpu " << DETECTOR_CPU << ": " << std::strerror(errno) << std::endl;
+      if(DETECTOR_PRIO > 0 && !setThreadPriority(pthread_self(), DETECTOR_PRIO))
+        std::cerr << "[opendlv-eeg-usb]: Failed to set detector priority " << DETECTOR_PRIO << ": " << std::strerror(errno) << std::endl;
+      
+      std::clog << "[opendlv-eeg-usb]: reader:   " << threadReport(eeg.readerHandle()) << std::endl;
+      std::clog << "[opendlv-eeg-usb]: detector: " << threadReport(pthread_self()) << std::endl;
+      std::clog << "[opendlv-eeg-usb]: " << memoryReport() << std::endl;
 
       while(!eeg.isInitialized())
       {
@@ -88,23 +180,58 @@ int32_t main(int32_t argc, char **argv) {
       std::cout << std::endl;
       eeg.stop(); //to make sure everything works as intended;
       std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      if(RATE != SAMPLE_RATE)
+      {
+        eeg.setSampleRate(static_cast<uint32_t>(RATE)); // checked against the Cyton rates above
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      }
       eeg.start();
 
+      std::signal(SIGUSR1, onTraceSignal);
+      auto lastTrace = std::chrono::steady_clock::now();
+
       while (od4.isRunning()) {
 	/*it is unnecessary to check for P300 too often */
         std::this_thread::sleep_for(std::chrono::milliseconds(FREQ));
+        
+        if(traceRequested.exchange(false))
+          std::cerr << LatencyTrace::report();
+        
+        if(TRACE > 0 && std::chrono::steady_clock::now() - lastTrace >= std::chrono::seconds(TRACE))
+        {
+          lastTrace = std::chrono::steady_clock::now();
+          opendlv::system::LogMessage traceReport;
+          traceReport.level(7);
+          traceReport.description(LatencyTrace::report());
+          od4.send(traceReport);
+          if(VERBOSE)
+            std::cout << traceReport.description();
+        }
+        
         if(eeg.dataReady())
         {
           eeg.readData(eegArray);
+          
+          if(RAILING > 0.0)
+          {
+            size_t railing = p300.checkChannels(RAILING);
+            if(VERBOSE && railing > 0)
+              std::cout << "channels skipped: " << railing << std::endl;
+          }
 		  
           /* Microservice sends RATIO between the power spectrum 1-20 Hz of
            * the FIRST 300 ms of the signal and the remaining part of the buffer.
            * Buffer length is specified by BINS command. */
-          float difference = static_cast<float>(p300.detect());
+          float difference{0};
+          {
+            LatencySpan span(LatencyTrace::DETECT);
+            difference = static_cast<float>(p300.detect());
+          }
            
           if(VERBOSE)
             std::cout << "difference: " << difference << std::endl;
            
+	  LatencySpan span(LatencyTrace::PUBLISH);
 	  opendlv::proxy::VoltageReading p300Difference;
           p300Difference.voltage(difference);
           od4.send(p300Difference);
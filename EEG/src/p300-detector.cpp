@@ -17,23 +17,41 @@
 
 #include "p300-detector.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <stdlib.h>
 
-P300Detector::P300Detector(double** arr, size_t n_channels, size_t n_bins) noexcept
+P300Detector::P300Detector(double** arr, size_t n_channels, size_t n_bins, size_t rate) noexcept
 {
   eegArray = arr;
   bins = n_bins;
   channels = n_channels;
+  sample_rate = rate;
   
-  first_300_ms_length = 0.3*FREQUENCY;
+  if(channels > MAX_CHANNELS)
+  {
+    std::cout << "Caution: only the first " << MAX_CHANNELS << " channels are analysed." << std::endl;
+    channels = MAX_CHANNELS;
+  }
+  
+  for (size_t i = 0; i < MAX_CHANNELS; i++)
+    channel_weights[i] = 1.0;
+  
+  /* Window split and cut-off follow the rate the buffers are filled at
+   * (board rate, or analysis rate when the decoder decimates). */
+  first_300_ms_length = 3*sample_rate/10;
+  if(first_300_ms_length + 2 > bins)
+  {
+    std::cout << "Caution: " << bins << " bins do not cover 300 ms at " << sample_rate << " Hz, splitting the buffer in half." << std::endl;
+    first_300_ms_length = bins/2;
+  }
   post_300_ms_length = bins - first_300_ms_length;
   
   pre_output_size = first_300_ms_length/2 + 1;
   post_output_size = post_300_ms_length/2 + 1;
   
-  pre_20hz_cutoff = first_300_ms_length * 20/FREQUENCY;
-  post_20hz_cutoff = post_300_ms_length * 20/FREQUENCY;
+  pre_20hz_cutoff = first_300_ms_length * 20/sample_rate;
+  post_20hz_cutoff = post_300_ms_length * 20/sample_rate;
   
   arrayPre = new double[first_300_ms_length];
   arrayPost = new double[post_300_ms_length];
@@ -57,10 +75,22 @@ P300Detector::P300Detector(double** arr, size_t n_channels, size_t n_bins) noexc
 
 double P300Detector::detect() noexcept {
   
-  double total_pre{0}, total_post{0};
+  double total_pre{0}, total_post{0}, total_weight{0};
+  double weights[MAX_CHANNELS];
+  size_t contributing{0};
+  
+  /* Masks and weights may be changed from another thread at any time;
+   * work on a snapshot so that one detection uses a consistent set. */
+  {
+    std::lock_guard<std::mutex> lck(m_dataMutex);
+    for (size_t i = 0; i < channels; i++)
+      weights[i] = (channel_masked[i] || channel_railing[i]) ? 0.0 : channel_weights[i];
+  }
   
   for (size_t i = 0; i < channels; i++)
   {
+	if(!(weights[i] > 0.0)) continue; // masked channel: no FFT work
+	
 	double channel_sum{0}, channel_mean{0};
 	double sum_pre_channel{0}, sum_post_channel{0};
 	//std::lock_guard<std::mutex> lck(m_dataMutex[i]);
@@ -84,29 +114,88 @@ double P300Detector::detect() noexcept {
 		eegArray[i][b] -= channel_mean;
 		
     std::copy(eegArray[i] + 0, eegArray[i] + first_300_ms_length, arrayPre);
-    std::copy(eegArray[i] + first_300_ms_length, eegArray[i] + bins-1, arrayPost);
+    std::copy(eegArray[i] + first_300_ms_length, eegArray[i] + bins, arrayPost);
                                                
 	fftw_execute(plan_pre);
 	fftw_execute(plan_post);
 
-	for (int b = 1; b <= pre_20hz_cutoff; b++){
+	for (size_t b = 1; b <= pre_20hz_cutoff; b++){
 		double real = pre_output_buffer[b][0];
 		double imag = pre_output_buffer[b][1];
 		double abs2 = (real*real + imag*imag)/(pre_output_size);
 		sum_pre_channel += abs2;
 	}
 	
-	for (int b = 0; b <= post_20hz_cutoff; b++){
+	for (size_t b = 0; b <= post_20hz_cutoff; b++){
 		double real = post_output_buffer[b][0];
 		double imag = post_output_buffer[b][1];
 		double abs2 = (real*real + imag*imag)/(post_output_size);
 		sum_post_channel += abs2;
 	}
 	
-	total_pre += sum_pre_channel;
-	total_post += sum_post_channel;
+	total_pre += weights[i]*sum_pre_channel;
+	total_post += weights[i]*sum_post_channel;
+	total_weight += weights[i];
+	contributing++;
+  }
+  
+  if(!(total_weight > 0.0)) return 0.0; // every channel is masked
+  
+  /* Weighted means; with unit weights this reduces to the plain sum over
+   * the pre-window and the mean over the post-window. */
+  total_post /= total_weight;
+  total_pre = contributing*total_pre/total_weight;
+  
+  if(total_pre < 1.0) return total_post;
+  else return total_post/total_pre;
+}
+
+void P300Detector::setChannelWeight(size_t channel, double weight) noexcept
+{
+  if(channel >= channels) return;
+  std::lock_guard<std::mutex> lck(m_dataMutex);
+  channel_weights[channel] = (weight > 0.0) ? weight : 0.0;
+}
+
+void P300Detector::setChannelActive(size_t channel, bool active) noexcept
+{
+  if(channel >= channels) return;
+  std::lock_guard<std::mutex> lck(m_dataMutex);
+  channel_masked[channel] = !active;
+}
+
+size_t P300Detector::checkChannels(double max_amplitude) noexcept
+{
+  /* Flags channels whose current buffer is flat (disconnected or railed
+   * at the ADC limit) or whose peak-to-peak amplitude exceeds the given
+   * limit. Must be called on fresh data, before detect() removes the mean.
+   * Returns the number of channels flagged. */
+  size_t flagged{0};
+  bool railing[MAX_CHANNELS];
+  
+  for (size_t i = 0; i < channels; i++)
+  {
+	double min_value{eegArray[i][0]}, max_value{eegArray[i][0]};
+	for(size_t b = 1; b < bins; b++)
+	{
+		if(eegArray[i][b] < min_value) min_value = eegArray[i][b];
+		if(eegArray[i][b] > max_value) max_value = eegArray[i][b];
+	}
+	
+	railing[i] = !(max_value > min_value) || (max_value - min_value > max_amplitude);
+	if(railing[i]) flagged++;
   }
   
-  if(total_pre < 1.0) return total_post/channels;
-  else return (total_post/channels)/total_pre;
+  std::lock_guard<std::mutex> lck(m_dataMutex);
+  std::copy(railing, railing + channels, channel_railing);
+  return flagged;
+}
+
+size_t P300Detector::activeChannels() const noexcept
+{
+  std::lock_guard<std::mutex> lck(m_dataMutex);
+  size_t active{0};
+  for (size_t i = 0; i < channels; i++)
+	if(!channel_masked[i] && !channel_railing[i] && channel_weights[i] > 0.0) active++;
+  return active;
 }
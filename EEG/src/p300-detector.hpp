@@ -28,11 +28,15 @@
 class P300Detector {
  public:
   P300Detector() = delete;
-  P300Detector(double**, size_t, size_t) noexcept;
+  P300Detector(double**, size_t, size_t, size_t rate = FREQUENCY) noexcept;
   ~P300Detector() = default;
 
  public:
   double detect() noexcept;
+  void setChannelWeight(size_t, double) noexcept;
+  void setChannelActive(size_t, bool) noexcept;
+  size_t checkChannels(double) noexcept;
+  size_t activeChannels() const noexcept;
   
  private:
   fftw_plan  plan_pre{0}, plan_post{0};
@@ -42,13 +46,17 @@ class P300Detector {
   size_t post_300_ms_length{0};
   size_t channels{1};
   size_t bins{1};
-  uint16_t pre_20hz_cutoff{0};
-  uint16_t post_20hz_cutoff{0};
-  uint16_t pre_output_size{1};
-  uint16_t post_output_size{1};
+  size_t sample_rate{FREQUENCY};
+  size_t pre_20hz_cutoff{0};
+  size_t post_20hz_cutoff{0};
+  size_t pre_output_size{1};
+  size_t post_output_size{1};
   double* arrayPre = nullptr;
   double* arrayPost = nullptr;
   double** eegArray = nullptr;
+  double channel_weights[MAX_CHANNELS]{};
+  bool channel_masked[MAX_CHANNELS]{};
+  bool channel_railing[MAX_CHANNELS]{};
   mutable std::mutex m_resultsMutex{};
   mutable std::mutex m_dataMutex{};
   //unsigned int flags[] = {FFTW_ESTIMATE, FFTW_FORWARD};
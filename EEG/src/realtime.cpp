@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2019 Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "realtime.hpp"
+
+#include <sched.h>
+#include <sys/mman.h>
+
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+
+bool setThreadAffinity(pthread_t thread, int cpu) noexcept
+{
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  int result = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+  if (0 != result) errno = result;
+  return 0 == result;
+}
+
+bool setThreadPriority(pthread_t thread, int priority) noexcept
+{
+  sched_param param{};
+  param.sched_priority = priority;
+  int result = pthread_setschedparam(thread, SCHED_FIFO, &param);
+  if (0 != result) errno = result;
+  return 0 == result;
+}
+
+bool lockMemory() noexcept
+{
+  // MCL_CURRENT also faults in everything that is mapped already.
+  return 0 == mlockall(MCL_CURRENT | MCL_FUTURE);
+}
+
+void prefaultStack() noexcept
+{
+  volatile unsigned char stack[PREFAULT_STACK_SIZE];
+  for (size_t i = 0; i < PREFAULT_STACK_SIZE; i += 4096)
+    stack[i] = 0;
+  static_cast<void>(stack[0]);
+}
+
+std::string threadReport(pthread_t thread)
+{
+  std::stringstream out;
+
+  int policy{0};
+  sched_param param{};
+  if (0 == pthread_getschedparam(thread, &policy, &param))
+  {
+    out << ((SCHED_FIFO == policy) ? "SCHED_FIFO" : (SCHED_RR == policy) ? "SCHED_RR" : "SCHED_OTHER")
+        << " priority " << param.sched_priority;
+  }
+
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  if (0 == pthread_getaffinity_np(thread, sizeof(cpus), &cpus))
+  {
+    out << ", cpus";
+    for (int i = 0; i < CPU_SETSIZE; i++)
+      if (CPU_ISSET(i, &cpus)) out << " " << i;
+  }
+  return out.str();
+}
+
+std::string memoryReport()
+{
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+  {
+    if (0 == line.compare(0, 6, "VmLck:"))
+    {
+      return "locked memory: " + line.substr(line.find_first_not_of(" \t", 6));
+    }
+  }
+  return "locked memory: unknown";
+}
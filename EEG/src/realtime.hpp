@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2019 Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REALTIME_
+#define REALTIME_
+
+#include <pthread.h>
+
+#include <string>
+
+#define PREFAULT_STACK_SIZE (64*1024)
+
+/* Helpers to run the EEG service with real-time settings. All of them
+ * return false and leave errno set if the kernel refused the request
+ * (usually missing CAP_SYS_NICE / CAP_IPC_LOCK or a rlimit). */
+bool setThreadAffinity(pthread_t, int) noexcept;
+bool setThreadPriority(pthread_t, int) noexcept;
+bool lockMemory() noexcept;
+void prefaultStack() noexcept;
+std::string threadReport(pthread_t);
+std::string memoryReport();
+
+#endif
@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2019 Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cluon-complete.hpp"
+
+#include "opendlv-standard-message-set.hpp"
+#include "eeg-decoder.hpp"
+#include "p300-detector.hpp"
+#include "ring_span.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define PACKET_BYTES 33
+
+/* Timings of one benchmark, in nanoseconds per iteration. */
+struct BenchResult
+{
+  std::string name;
+  size_t channels;
+  size_t bins;
+  size_t iterations;
+  double min_ns;
+  double median_ns;
+  double p99_ns;
+  double mean_ns;
+  double mb_per_s;
+};
+
+/* Holds the ring buffers a decoder writes into, as EEG::EEG sets them up. */
+struct Buffers
+{
+  std::vector<double*> values;
+  std::vector<nonstd::ring_span_lite::ring_span<double>*> rings;
+
+  Buffers(size_t channels, size_t bins) : values(channels), rings(channels)
+  {
+    for (size_t i = 0; i < channels; i++)
+    {
+      values[i] = new double[bins]();
+      rings[i] = new nonstd::ring_span_lite::ring_span<double>(values[i], values[i] + bins, values[i], bins);
+    }
+  }
+
+  ~Buffers()
+  {
+    for (size_t i = 0; i < values.size(); i++)
+    {
+      delete rings[i];
+      delete [] values[i];
+    }
+  }
+
+  Buffers(const Buffers &) = delete;
+  Buffers &operator=(const Buffers &) = delete;
+};
+
+/* OpenBCI Cyton stream: header, sample number, 8x24 bit EEG, 6 aux bytes, footer. */
+static std::vector<uint8_t> makeStream(size_t packets)
+{
+  std::vector<uint8_t> stream;
+  stream.reserve(packets*PACKET_BYTES);
+  for (size_t p = 0; p < packets; p++)
+  {
+    stream.push_back(EEGDecoder::HEADER_EEG);
+    stream.push_back(static_cast<uint8_t>(p));
+    for (size_t c = 0; c < CHANNEL_TOTAL; c++)
+    {
+      int32_t value = static_cast<int32_t>(100000*std::sin(0.05*static_cast<double>(p + 7*c)));
+      stream.push_back(static_cast<uint8_t>((value >> 16) & 0xFF));
+      stream.push_back(static_cast<uint8_t>((value >> 8) & 0xFF));
+      stream.push_back(static_cast<uint8_t>(value & 0xFF));
+    }
+    for (size_t a = 0; a < 6; a++) stream.push_back(0);
+    stream.push_back(EEGDecoder::HEADER_ACC);
+  }
+  return stream;
+}
+
+static EEGDecoder* makeDecoder(Buffers &buffers, size_t channels, size_t bins, size_t decimation = 1)
+{
+  const uint8_t INIT[3] = {EEGDecoder::INIT, EEGDecoder::INIT, EEGDecoder::INIT};
+  EEGDecoder* decoder = new EEGDecoder(buffers.rings.data(), channels, bins, decimation);
+  decoder->decode(INIT, 3);
+  return decoder;
+}
+
+template <typename F>
+static BenchResult measure(const std::string &name, size_t channels, size_t bins, size_t iterations, F &&f)
+{
+  std::vector<double> samples(iterations);
+  for (size_t i = 0; i < iterations/10 + 1; i++) f(); // warm-up
+
+  for (size_t i = 0; i < iterations; i++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    samples[i] = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+  }
+
+  std::sort(samples.begin(), samples.end());
+  double sum{0};
+  for (double s : samples) sum += s;
+
+  return BenchResult{name, channels, bins, iterations, samples.front(), samples[iterations/2],
+                     samples[std::min(iterations - 1, iterations*99/100)], sum/static_cast<double>(iterations), 0.0};
+}
+
+static BenchResult benchDecode(size_t channels, size_t iterations, size_t decimation = 1)
+{
+  const size_t BINS{256};
+  const std::vector<uint8_t> stream = makeStream(1000);
+  Buffers buffers(channels, BINS);
+  EEGDecoder* decoder = makeDecoder(buffers, channels, BINS, decimation);
+
+  BenchResult result = measure((decimation > 1) ? "decode-decimate-" + std::to_string(decimation) : "decode", channels, BINS, iterations, [&](){
+    decoder->decode(stream.data(), stream.size());
+  });
+  result.mb_per_s = static_cast<double>(stream.size())/result.median_ns*1e3;
+
+  delete decoder;
+  return result;
+}
+
+static BenchResult benchReadData(size_t channels, size_t bins, size_t iterations)
+{
+  const std::vector<uint8_t> stream = makeStream(bins + 1);
+  Buffers buffers(channels, bins);
+  EEGDecoder* decoder = makeDecoder(buffers, channels, bins);
+  decoder->decode(stream.data(), stream.size());
+
+  std::vector<double*> out(channels);
+  for (size_t i = 0; i < channels; i++) out[i] = new double[bins];
+
+  BenchResult result = measure("readData", channels, bins, iterations, [&](){
+    decoder->readData(out.data());
+  });
+  result.mb_per_s = static_cast<double>(channels*bins*sizeof(double))/result.median_ns*1e3;
+
+  for (size_t i = 0; i < channels; i++) delete [] out[i];
+  delete decoder;
+  return result;
+}
+
+static BenchResult benchDetect(size_t channels, size_t bins, size_t iterations)
+{
+  std::vector<double*> eeg(channels);
+  std::vector<double> source(bins);
+  for (size_t b = 0; b < bins; b++)
+    source[b] = 1000 + 50*std::sin(2*M_PI*8*static_cast<double>(b)/FREQUENCY);
+  for (size_t i = 0; i < channels; i++) eeg[i] = new double[bins];
+
+  P300Detector detector(eeg.data(), channels, bins);
+  volatile double sink{0};
+
+  // detect() normalises in place; refreshing the input is part of the cost
+  // the service pays through readData, so it is timed as well.
+  BenchResult result = measure("detect", channels, bins, iterations, [&](){
+    for (size_t i = 0; i < channels; i++) std::copy(source.begin(), source.end(), eeg[i]);
+    sink = detector.detect();
+  });
+  (void)sink;
+
+  for (size_t i = 0; i < channels; i++) delete [] eeg[i];
+  return result;
+}
+
+static BenchResult benchEndToEnd(size_t channels, size_t bins, size_t iterations)
+{
+  /* One new sample arriving on the serial line up to the serialised
+   * VoltageReading that od4.send() would put on the wire. */
+  const std::vector<uint8_t> warmup = makeStream(bins + 1);
+  const std::vector<uint8_t> packet = makeStream(1);
+  Buffers buffers(channels, bins);
+  EEGDecoder* decoder = makeDecoder(buffers, channels, bins);
+  decoder->decode(warmup.data(), warmup.size());
+
+  std::vector<double*> eeg(channels);
+  for (size_t i = 0; i < channels; i++) eeg[i] = new double[bins];
+  P300Detector detector(eeg.data(), channels, bins);
+  volatile size_t sink{0};
+
+  BenchResult result = measure("sample-to-publish", channels, bins, iterations, [&](){
+    decoder->decode(packet.data(), packet.size());
+    decoder->readData(eeg.data());
+
+    opendlv::proxy::VoltageReading p300Difference;
+    p300Difference.voltage(static_cast<float>(detector.detect()));
+
+    cluon::ToProtoVisitor protoEncoder;
+    cluon::data::Envelope envelope;
+    envelope.dataType(static_cast<int32_t>(p300Difference.ID()));
+    p300Difference.accept(protoEncoder);
+    envelope.serializedData(protoEncoder.encodedData());
+    envelope.sent(cluon::time::now());
+    envelope.sampleTimeStamp(envelope.sent());
+    sink = cluon::serializeEnvelope(std::move(envelope)).size();
+  });
+  (void)sink;
+
+  for (size_t i = 0; i < channels; i++) delete [] eeg[i];
+  delete decoder;
+  return result;
+}
+
+static void writeJSON(std::ostream &out, const std::vector<BenchResult> &results, const std::string &label)
+{
+  out << "{\n  \"label\": \"" << label << "\",\n  \"benchmarks\": [\n";
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const BenchResult &r = results[i];
+    out << "    {\"name\": \"" << r.name << "\", \"channels\": " << r.channels << ", \"bins\": " << r.bins
+        << ", \"iterations\": " << r.iterations << ", \"min_ns\": " << r.min_ns << ", \"median_ns\": " << r.median_ns
+        << ", \"p99_ns\": " << r.p99_ns << ", \"mean_ns\": " << r.mean_ns << ", \"mb_per_s\": " << r.mb_per_s << "}"
+        << ((i + 1 < results.size()) ? ",\n" : "\n");
+  }
+  out << "  ]\n}\n";
+}
+
+int32_t main(int32_t argc, char **argv) {
+  auto commandlineArguments = cluon::getCommandlineArguments(argc, argv);
+  const std::string JSON{(commandlineArguments.count("json") != 0) ? commandlineArguments["json"] : "eeg-bench.json"};
+  const std::string LABEL{(commandlineArguments.count("label") != 0) ? commandlineArguments["label"] : ""};
+  const size_t ITERATIONS{(commandlineArguments.count("iterations") != 0) ? static_cast<size_t>(std::stoi(commandlineArguments["iterations"])) : 200};
+
+  const size_t CHANNELS[] = {1, 4, 8};
+  const size_t BINS[] = {128, 256, 512, 1024};
+
+  // The decoder reports its state on stdout; keep the results readable.
+  std::stringstream decoderLog;
+  std::streambuf* coutBuffer = std::cout.rdbuf(decoderLog.rdbuf());
+
+  std::vector<BenchResult> results;
+  for (size_t channels : CHANNELS)
+    results.push_back(benchDecode(channels, ITERATIONS));
+  results.push_back(benchDecode(8, ITERATIONS, 4));
+  for (size_t channels : CHANNELS)
+    for (size_t bins : BINS)
+      results.push_back(benchReadData(channels, bins, ITERATIONS));
+  for (size_t channels : CHANNELS)
+    for (size_t bins : BINS)
+      results.push_back(benchDetect(channels, bins, ITERATIONS));
+  for (size_t channels : CHANNELS)
+    results.push_back(benchEndToEnd(channels, 256, ITERATIONS));
+
+  std::cout.rdbuf(coutBuffer);
+
+  for (const BenchResult &r : results)
+  {
+    std::cout << r.name << " channels=" << r.channels << " bins=" << r.bins
+              << ": median " << r.median_ns/1e3 << " us, p99 " << r.p99_ns/1e3 << " us";
+    if (r.mb_per_s > 0.0) std::cout << ", " << r.mb_per_s << " MB/s";
+    std::cout << std::endl;
+  }
+
+  std::ofstream out(JSON);
+  writeJSON(out, results, LABEL);
+  std::cout << "Results written to " << JSON << std::endl;
+  return 0;
+}
@@ -18,9 +18,11 @@
 #define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
 #include "catch.hpp"
 
+#include "decimator.hpp"
 #include "eeg-decoder.hpp"
 #include "ring_span.hpp"
 
+#include <cmath>
 #include <vector>
 
 #define CHANNEL_NO 1
@@ -66,3 +68,61 @@ TEST_CASE("Test INIT") {
   //   REQUIRE(false == decoder.getStatus());
   //}
 }
+
+static std::vector<uint8_t> makePackets(size_t count)
+{
+  std::vector<uint8_t> stream{0x24, 0x24, 0x24};
+  for (size_t p = 0; p < count; p++)
+  {
+    stream.push_back(0xA0);
+    stream.push_back(static_cast<uint8_t>(p));
+    for (size_t b = 0; b < 30; b++) stream.push_back(0x01);
+    stream.push_back(0xC0);
+  }
+  return stream;
+}
+
+TEST_CASE("Test decimation") {
+  const static size_t buffer_len{5};
+  double* arr[CHANNEL_NO];
+  nonstd::ring_span_lite::ring_span<double>* buffers[CHANNEL_NO];
+  arr[0] = new double[buffer_len];
+  buffers[0] = new nonstd::ring_span_lite::ring_span<double>(arr[0], arr[0] + buffer_len, arr[0], buffer_len);
+
+  EEGDecoder decoder(buffers, CHANNEL_NO, buffer_len, 4);
+
+  // Every fourth sample reaches the buffer: 5 buffered samples need 24 packets.
+  std::vector<uint8_t> stream = makePackets(20);
+  decoder.decode(stream.data(), stream.size());
+  REQUIRE(false == decoder.dataReady());
+
+  stream = makePackets(8);
+  decoder.decode(stream.data() + 3, stream.size() - 3);
+  REQUIRE(true == decoder.dataReady());
+
+  delete buffers[0];
+  delete [] arr[0];
+}
+
+TEST_CASE("Test decimator filter") {
+  Decimator decimator(4, 2);
+  REQUIRE(4 == decimator.factor());
+
+  size_t produced{0};
+  double in[2], out[2];
+  for (size_t n = 0; n < 400; n++)
+  {
+    in[0] = 10.0;                       // DC passes unchanged
+    in[1] = (n % 2 == 0) ? 10.0 : -10.0; // Nyquist tone is removed
+    if (decimator.push(in, out))
+    {
+      produced++;
+      if (n > decimator.taps())
+      {
+        REQUIRE(10.0 == Approx(out[0]));
+        REQUIRE(std::fabs(out[1]) < 0.1);
+      }
+    }
+  }
+  REQUIRE(100 == produced);
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2019 Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "catch.hpp"
+
+#include "latency-trace.hpp"
+
+TEST_CASE("Test histogram percentiles") {
+  LatencyHistogram histogram;
+  REQUIRE(0 == histogram.percentile(50));
+
+  for (uint64_t v = 1; v <= 10000; v++)
+    histogram.record(v*1000);
+
+  REQUIRE(10000 == histogram.count());
+  REQUIRE(10000000 == histogram.max());
+  REQUIRE(5000500.0 == Approx(histogram.mean()));
+  // Buckets are accurate to 1/16 of the value.
+  REQUIRE(5000000.0 == Approx(static_cast<double>(histogram.percentile(50))).epsilon(0.0625));
+  REQUIRE(9900000.0 == Approx(static_cast<double>(histogram.percentile(99))).epsilon(0.0625));
+
+  histogram.reset();
+  REQUIRE(0 == histogram.count());
+}
+
+TEST_CASE("Test small and huge values") {
+  LatencyHistogram histogram;
+  histogram.record(0);
+  histogram.record(31);
+  REQUIRE(0 == histogram.percentile(0));
+  REQUIRE(31 == histogram.percentile(100));
+
+  histogram.record(1ULL << 50); // beyond the range: counted in the last bucket
+  REQUIRE(3 == histogram.count());
+  REQUIRE(histogram.percentile(100) >= (1ULL << 40));
+}
+
+TEST_CASE("Test stage spans") {
+  LatencyTrace::reset();
+  {
+    LatencySpan span(LatencyTrace::DETECT);
+  }
+  REQUIRE(1 == LatencyTrace::histogram(LatencyTrace::DETECT).count());
+  REQUIRE(0 == LatencyTrace::histogram(LatencyTrace::DECODE).count());
+  REQUIRE(std::string::npos != LatencyTrace::report().find("detect"));
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2019 Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "catch.hpp"
+
+#include "p300-detector.hpp"
+
+#include <cmath>
+
+#define TEST_BINS 128
+
+static void fillChannel(double* channel, double amplitude, double frequency)
+{
+  for (size_t b = 0; b < TEST_BINS; b++)
+    channel[b] = 1000 + amplitude*std::sin(2*M_PI*frequency*b/FREQUENCY) + ((b > 75) ? amplitude : 0);
+}
+
+TEST_CASE("Test channel masking") {
+  double* single[1];
+  double* pair[2];
+  single[0] = new double[TEST_BINS];
+  pair[0] = new double[TEST_BINS];
+  pair[1] = new double[TEST_BINS];
+
+  P300Detector reference(single, 1, TEST_BINS);
+  P300Detector detector(pair, 2, TEST_BINS);
+
+  fillChannel(single[0], 50, 8);
+  double expected = reference.detect();
+
+  // The second channel is railing; once masked it must not contribute.
+  fillChannel(pair[0], 50, 8);
+  fillChannel(pair[1], 5000, 3);
+  detector.setChannelActive(1, false);
+  REQUIRE(1 == detector.activeChannels());
+  REQUIRE(expected == Approx(detector.detect()));
+
+  detector.setChannelActive(0, false);
+  REQUIRE(0 == detector.activeChannels());
+  REQUIRE(0.0 == Approx(detector.detect()));
+
+  delete [] single[0];
+  delete [] pair[0];
+  delete [] pair[1];
+}
+
+TEST_CASE("Test channel weights") {
+  double* pair[2];
+  pair[0] = new double[TEST_BINS];
+  pair[1] = new double[TEST_BINS];
+
+  P300Detector detector(pair, 2, TEST_BINS);
+
+  fillChannel(pair[0], 50, 8);
+  fillChannel(pair[1], 50, 8);
+  double equal = detector.detect();
+
+  // Identical channels give the same result whatever their weights are.
+  fillChannel(pair[0], 50, 8);
+  fillChannel(pair[1], 50, 8);
+  detector.setChannelWeight(1, 0.25);
+  REQUIRE(equal == Approx(detector.detect()));
+
+  detector.setChannelWeight(1, 0.0);
+  REQUIRE(1 == detector.activeChannels());
+
+  delete [] pair[0];
+  delete [] pair[1];
+}
+
+TEST_CASE("Test railing channels") {
+  double* pair[2];
+  pair[0] = new double[TEST_BINS];
+  pair[1] = new double[TEST_BINS];
+
+  P300Detector detector(pair, 2, TEST_BINS);
+
+  fillChannel(pair[0], 50, 8);
+  for (size_t b = 0; b < TEST_BINS; b++)
+    pair[1][b] = 8388607; // stuck at the ADC limit
+
+  REQUIRE(1 == detector.checkChannels(1000));
+  REQUIRE(1 == detector.activeChannels());
+
+  fillChannel(pair[1], 50, 8);
+  REQUIRE(0 == detector.checkChannels(1000));
+  REQUIRE(2 == detector.activeChannels());
+
+  delete [] pair[0];
+  delete [] pair[1];
+}
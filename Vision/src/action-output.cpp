@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2019  Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "action-output.hpp"
+
+#include <cmath>
+#include <iostream>
+
+ActionOutput::ActionOutput(int period, int refresh) noexcept :
+    m_period(period), m_refresh(refresh), m_started(false), m_action(0), m_angle(0), m_last(),
+    m_messages(0), m_coalesced(0), m_bytes(0), m_reported(), m_reportedMessages(0), m_reportedBytes(0)
+{
+}
+
+// True when the action should be sent now; it is then taken as sent.
+bool ActionOutput::offer(uint16_t action, float angle, Time now) noexcept
+{
+    if (!m_started)
+    {
+        m_started = true;
+        m_reported = now;
+    }
+    else
+    {
+        const bool changed = action != m_action || std::fabs(angle - m_angle) >= ACTION_ANGLE_STEP;
+        const auto since = now - m_last;
+        if ((changed && since < m_period) || (!changed && since < m_refresh))
+        {
+            m_coalesced++;
+            return false;
+        }
+    }
+
+    m_action = action;
+    m_angle = angle;
+    m_last = now;
+    m_messages++;
+    return true;
+}
+
+void ActionOutput::sent(size_t bytes) noexcept
+{
+    m_bytes += bytes;
+}
+
+// Prints the send rate since the last report, then starts a new window.
+void ActionOutput::report(std::ostream &out, Time now) noexcept
+{
+    const double seconds = std::chrono::duration<double>(now - m_reported).count();
+    if (seconds <= 0) return;
+    out << "Actions: " << (m_messages - m_reportedMessages)/seconds << " msg/s, "
+        << (m_bytes - m_reportedBytes)/seconds << " B/s, "
+        << m_messages << " sent and " << m_coalesced << " held back in total" << std::endl;
+    m_reported = now;
+    m_reportedMessages = m_messages;
+    m_reportedBytes = m_bytes;
+}
+
+uint64_t ActionOutput::messages() const noexcept
+{
+    return m_messages;
+}
+
+uint64_t ActionOutput::coalesced() const noexcept
+{
+    return m_coalesced;
+}
+
+uint64_t ActionOutput::bytes() const noexcept
+{
+    return m_bytes;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2019  Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ACTION_OUTPUT_HPP_INCLUDED
+#define ACTION_OUTPUT_HPP_INCLUDED
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+
+#define ACTION_PERIOD_MS 50    // shortest time between two sent actions
+#define ACTION_REFRESH_MS 500  // an unchanged action is sent again this often
+#define ACTION_ANGLE_STEP 0.01 // smaller changes of the angle are not sent
+
+/*
+    Decides which of the actions chosen frame by frame go on the OD4 bus.
+    A changed action is sent at once unless the last one went out less than
+    `period` ago; it then waits, and whatever action is current when the
+    period is over is sent in place of the ones in between. An unchanged
+    action is only repeated every `refresh`, so that listeners can tell the
+    service is alive. Counts what was sent and what was held back.
+*/
+class ActionOutput
+{
+ public:
+    typedef std::chrono::steady_clock::time_point Time;
+
+    ActionOutput(int period = ACTION_PERIOD_MS, int refresh = ACTION_REFRESH_MS) noexcept;
+    bool offer(uint16_t action, float angle, Time now) noexcept;
+    void sent(size_t bytes) noexcept;
+    void report(std::ostream&, Time now) noexcept;
+
+    uint64_t messages() const noexcept;
+    uint64_t coalesced() const noexcept;
+    uint64_t bytes() const noexcept;
+
+ private:
+    std::chrono::milliseconds m_period;
+    std::chrono::milliseconds m_refresh;
+    bool m_started;
+    uint16_t m_action;  // last sent
+    float m_angle;
+    Time m_last;
+    uint64_t m_messages;
+    uint64_t m_coalesced;
+    uint64_t m_bytes;
+    Time m_reported;    // start of the window of the next report
+    uint64_t m_reportedMessages;
+    uint64_t m_reportedBytes;
+};
+
+#endif // ACTION_OUTPUT_HPP_INCLUDED
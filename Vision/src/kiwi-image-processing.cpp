@@ -17,123 +17,201 @@
 
 #include "kiwi-image-processing.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 //using namespace cv;
 
+// cells of the four 5x5 markers that are white, row by row
+static const char *MARKER_CELLS[4] = {
+    "....." "..W.." "....." ".W..." ".....",
+    "....." "....." ".W.W." ".W..." ".....",
+    "....." "....." "..W.." ".WW.." ".....",
+    "....." ".W.W." "....." "..WW." ".....",
+};
+
 cv::Mat create_border_image(int width, int height)
 {
-    cv::Mat background(height, width, CV_8UC4, cv::Scalar(200,200,200));
-    cv::Mat out = add_markers(background);
+    cv::Mat background(height, width + 2*MARKER_SIZE, CV_8UC4, cv::Scalar(200,200,200));
+    add_markers(background);
+    return background;
+}
+
+void add_markers(cv::Mat &background) noexcept
+{
+    const int cell = MARKER_SIZE/5;
+    const int right = background.cols - MARKER_SIZE;
+    const int bottom = background.rows - MARKER_SIZE;
+    const cv::Point corners[4] = {cv::Point(0,0), cv::Point(0,bottom), cv::Point(right,0), cv::Point(right,bottom)};
+
+    for (int m = 0; m < 4; m++)
+    {
+        background(cv::Rect(corners[m], cv::Size(MARKER_SIZE,MARKER_SIZE))).setTo(cv::Scalar(0,0,0,255));
+        for (int i = 0; i < 25; i++)
+        {
+            if (MARKER_CELLS[m][i] != 'W') continue;
+            cv::Rect square(corners[m].x + (i%5)*cell, corners[m].y + (i/5)*cell, cell, cell);
+            background(square).setTo(cv::Scalar(255,255,255,255));
+        }
+    }
+}
+
+cv::Mat cleanMask(cv::Mat input) noexcept
+{
+    cv::Mat mask, out;
+    cv::threshold(input, mask, 220.0, 255.0, cv::THRESH_BINARY);
+    cleanMask(mask, out);
     return out;
 }
 
-cv::Mat add_markers(cv::Mat mat) noexcept
+void cleanMask(const cv::Mat& mask, cv::Mat& out) noexcept
 {
-    uint16_t width = mat.cols;
-    uint16_t height = mat.rows;
+    static const cv::Mat element = cv::getStructuringElement(cv::MORPH_RECT,
+        cv::Size(2 * MASK_OPENING + 1, 2 * MASK_OPENING + 1),
+        cv::Point(MASK_OPENING, MASK_OPENING));
 
-    cv::Mat marker1(5, 5, CV_8UC1, cv::Scalar(0));
-    cv::Mat marker2(5, 5, CV_8UC1, cv::Scalar(0));
-    cv::Mat marker3(5, 5, CV_8UC1, cv::Scalar(0));
-    cv::Mat marker4(5, 5, CV_8UC1, cv::Scalar(0));
-    cv::Mat marker1_r, marker2_r, marker3_r, marker4_r;
+    // Erosion followed by dilation; OpenCV filters a rectangle separably
+    // by rows and columns.
+    cv::morphologyEx(mask, out, cv::MORPH_OPEN, element);
+}
 
-    marker1.at<uchar>(3,1) = 255;
-    marker1.at<uchar>(1,2) = 255;
+/*
+    Per-value weight 1 - |v-127|/127 used by the colour corrections:
+    mid-tones are shifted the most, saturated values not at all.
+*/
+struct WeightTable
+{
+    float w[256];
 
-    marker2.at<uchar>(2,1) = 255;
-    marker2.at<uchar>(2,3) = 255;
-    marker2.at<uchar>(3,1) = 255;
+    WeightTable() noexcept
+    {
+        for (int v = 0; v < 256; ++v)
+            w[v] = 1 - (abs(v - 127)/127.0f);
+    }
+};
 
-    marker3.at<uchar>(3,1) = 255;
-    marker3.at<uchar>(2,2) = 255;
-    marker3.at<uchar>(3,2) = 255;
+static const WeightTable WEIGHTS;
 
-    marker4.at<uchar>(1,1) = 255;
-    marker4.at<uchar>(3,3) = 255;
-    marker4.at<uchar>(1,3) = 255;
-    marker4.at<uchar>(3,2) = 255;
+/*
+    Identity tables for one to four channels, for reading pixels through
+    "no table" without building one.
+*/
+struct IdentityTables
+{
+    uchar t[4][256 * 4];
 
-    cv::cvtColor(marker1, marker1, cv::COLOR_GRAY2BGRA);
-    cv::cvtColor(marker2, marker2, cv::COLOR_GRAY2BGRA);
-    cv::cvtColor(marker3, marker3, cv::COLOR_GRAY2BGRA);
-    cv::cvtColor(marker4, marker4, cv::COLOR_GRAY2BGRA);
+    IdentityTables() noexcept
+    {
+        for (int cn = 1; cn <= 4; ++cn)
+            for (int v = 0; v < 256; ++v)
+                for (int c = 0; c < cn; ++c)
+                    t[cn - 1][v * cn + c] = static_cast<uchar>(v);
+    }
 
-    cv::resize(marker1, marker1_r, cv::Size(100,100), 0, 0, cv::INTER_NEAREST);
-    cv::resize(marker2, marker2_r, cv::Size(100,100), 0, 0, cv::INTER_NEAREST);
-    cv::resize(marker3, marker3_r, cv::Size(100,100), 0, 0, cv::INTER_NEAREST);
-    cv::resize(marker4, marker4_r, cv::Size(100,100), 0, 0, cv::INTER_NEAREST);
+    const uchar* of(int channels) const noexcept
+    {
+        return t[channels - 1];
+    }
+};
 
-    cv::Mat background;
-    copyMakeBorder(mat, background, 0, 0, 100, 100, cv::BORDER_CONSTANT, cv::Scalar(200,200,200) );
-    marker1_r.copyTo(background(cv::Rect(0,0,100,100)));
-    marker2_r.copyTo(background(cv::Rect(0, height-100, 100,100)));
-    marker3_r.copyTo(background(cv::Rect(width+100, 0,100,100)));
-    marker4_r.copyTo(background(cv::Rect(width+100, height-100, 100,100)));
+static const IdentityTables IDENTITY;
 
-    return background;
+/*
+    All corrections below depend only on the value of each channel, so they
+    are expressed as 256-entry tables and applied with cv::LUT, which is
+    vectorized and runs in parallel over rows. Channels beyond BGR (alpha)
+    are passed through unchanged. Tables are written with create(), so a
+    buffer of the right type is filled without allocating.
+*/
+static void identity_lut(int channels, cv::Mat& lut) noexcept
+{
+    lut.create(1, 256, CV_8UC(channels));
+    memcpy(lut.ptr<uchar>(0), IDENTITY.of(channels), 256 * channels);
 }
 
-cv::Mat cleanMask(cv::Mat input) noexcept
+void compose_lut(cv::Mat& lut, const cv::Mat& second) noexcept
 {
-    cv::Mat mask, out;
-    cv::threshold(input, mask, 220.0, 255.0, cv::THRESH_BINARY);
+    /*
+        Turns lut into the table equivalent to applying lut, then second.
+    */
+    const int cn = lut.channels();
+    const uchar* b = second.ptr<uchar>(0);
+    uchar* entry = lut.ptr<uchar>(0);
+    for (int i = 0; i < 256 * cn; ++i)
+        entry[i] = b[entry[i] * cn + i % cn];
+}
 
-    int erosion_size = 4;
-    cv::Mat element = cv::getStructuringElement(cv::MORPH_RECT,
-	cv::Size(2 * erosion_size + 1, 2 * erosion_size + 1),
-	cv::Point(erosion_size, erosion_size));
+void brightness_lut(int channels, cv::Mat& lut) noexcept
+{
+    lut.create(1, 256, CV_8UC(channels));
+    uchar* entry = lut.ptr<uchar>(0);
+    for (int v = 0; v < 256; ++v, entry += channels) {
+        for (int c = 0; c < channels; ++c)
+            entry[c] = (c < 3) ? cv::saturate_cast<uchar>(v + static_cast<int>(10*WEIGHTS.w[v])) : static_cast<uchar>(v);
+    }
+}
 
-    // Apply erosion, dilation on the image
-    cv::erode(mask, out, element);
-    cv::dilate(out, out, element);
-    return out;
+cv::Mat brightness_lut(int channels) noexcept
+{
+    cv::Mat lut;
+    brightness_lut(channels, lut);
+    return lut;
 }
 
- void increase_brightness(cv::Mat mat) noexcept
- {
-    for (int y = 0; y < mat.rows; ++y) {
-        uchar* ptr = mat.ptr<uchar>(y);
-        for (int x = 0; x < mat.cols; ++x) {
-            int B = ptr[x * 3];
-            int G = ptr[x * 3 + 1];
-            int R = ptr[x * 3 + 2];
-
-            float scale_B = 1 - (abs(B - 127)/127.0f);
-            float scale_G = 1 - (abs(G - 127)/127.0f);
-            float scale_R = 1 - (abs(R - 127)/127.0f);
-
-            R += static_cast<int>(10*scale_R);
-            G += static_cast<int>(10*scale_G);
-            B += static_cast<int>(10*scale_B);
-
-            if (R > 255) R = 255;
-            if (G > 255) G = 255;
-            if (B > 255) B = 255;
-
-            ptr[x * 3] = static_cast<uchar>(B);
-            ptr[x * 3 + 1] = static_cast<uchar>(G);
-            ptr[x * 3 + 2] = static_cast<uchar>(R);
-        }
+void normalization_lut(cv::Scalar difference, float strength, int channels, cv::Mat& lut) noexcept
+{
+    int differences[3];
+    differences[0] = static_cast<int>(difference(0));
+    differences[1] = static_cast<int>(difference(1));
+    differences[2] = static_cast<int>(difference(2));
+
+    lut.create(1, 256, CV_8UC(channels));
+    uchar* entry = lut.ptr<uchar>(0);
+    for (int v = 0; v < 256; ++v, entry += channels) {
+        for (int c = 0; c < channels; ++c)
+            entry[c] = (c < 3) ? cv::saturate_cast<uchar>(v - static_cast<int>(differences[c]*WEIGHTS.w[v]*strength)) : static_cast<uchar>(v);
     }
- }
+}
 
-void balance_white(cv::Mat mat) noexcept
+cv::Mat normalization_lut(cv::Scalar difference, float strength, int channels) noexcept
+{
+    cv::Mat lut;
+    normalization_lut(difference, strength, channels, lut);
+    return lut;
+}
+
+void increase_brightness(cv::Mat mat) noexcept
+{
+    cv::LUT(mat, brightness_lut(mat.channels()), mat);
+}
+
+void white_balance_lut(const cv::Mat& mat, int step, const cv::Mat& prior, cv::Mat& lut) noexcept
 {
+    /*
+        Stretches each channel so that 5% of the pixels saturate at either
+        end. The percentiles are estimated from every step-th pixel in both
+        directions, which is plenty for a 256-bin histogram. If a prior
+        table is given, the histogram is taken of mat as seen through it.
+    */
 	double discard_ratio = 0.05;
 	int hists[3][256];
 	memset(hists, 0, 3 * 256 * sizeof(int));
 
-	for (int y = 0; y < mat.rows; ++y) {
-		uchar* ptr = mat.ptr<uchar>(y);
-		for (int x = 0; x < mat.cols; ++x) {
-			for (int j = 0; j < 3; ++j) {
-				hists[j][ptr[x * 3 + j]] += 1;
-			}
+	const int cn = mat.channels();
+	const uchar* m = prior.empty() ? IDENTITY.of(cn) : prior.ptr<uchar>(0);
+	int total = 0;
+	for (int y = 0; y < mat.rows; y += step) {
+		const uchar* ptr = mat.ptr<uchar>(y);
+		for (int x = 0; x < mat.cols; x += step) {
+			const uchar* pixel = ptr + x * cn;
+			hists[0][m[pixel[0] * cn]] += 1;
+			hists[1][m[pixel[1] * cn + 1]] += 1;
+			hists[2][m[pixel[2] * cn + 2]] += 1;
+			total++;
 		}
 	}
 
 	// cumulative histogram
-	int total = mat.cols*mat.rows;
 	int vmin[3], vmax[3];
 	for (int i = 0; i < 3; ++i) {
 		for (int j = 0; j < 255; ++j) {
@@ -149,79 +227,43 @@ void balance_white(cv::Mat mat) noexcept
 			vmax[i] += 1;
 	}
 
-
-	for (int y = 0; y < mat.rows; ++y) {
-		uchar* ptr = mat.ptr<uchar>(y);
-		for (int x = 0; x < mat.cols; ++x) {
-			for (int j = 0; j < 3; ++j) {
-				int val = ptr[x * 3 + j];
-				if (val < vmin[j])
-					val = vmin[j];
-				if (val > vmax[j])
-					val = vmax[j];
-				ptr[x * 3 + j] = static_cast<uchar>((val - vmin[j]) * 255.0 / (vmax[j] - vmin[j]));
+	lut.create(1, 256, CV_8UC(cn));
+	uchar* entry = lut.ptr<uchar>(0);
+	for (int v = 0; v < 256; ++v, entry += cn) {
+		for (int j = 0; j < cn; ++j) {
+			if (j > 2 || vmax[j] <= vmin[j]) {
+				entry[j] = static_cast<uchar>(v); // alpha, or a flat channel
+				continue;
 			}
+			int val = std::min(std::max(v, vmin[j]), vmax[j]);
+			entry[j] = static_cast<uchar>((val - vmin[j]) * 255.0 / (vmax[j] - vmin[j]));
 		}
 	}
 }
 
-void normalize_image(cv::Mat in, cv::Mat out, cv::Scalar values, cv::Scalar goal, float strength) noexcept
+cv::Mat white_balance_lut(const cv::Mat& mat, int step, const cv::Mat& prior) noexcept
 {
-    cv::Mat mat = in.clone();
-
-    int difference_B = static_cast<int>(values(0) - goal(0));
-    int difference_G = static_cast<int>(values(1) - goal(1));
-    int difference_R = static_cast<int>(values(2) - goal(2));
-
-    //std::cout << difference_B + difference_G + difference_R  << std::endl;
-    if (difference_B + difference_G + difference_R < -60)
-    {
-        increase_brightness(mat);
-        balance_white(mat);
-        normalize_t(mat);
-        return;
-    }
-
-    for (int y = 0; y < mat.rows; ++y) {
-        uchar* ptr = mat.ptr<uchar>(y);
-        for (int x = 0; x < mat.cols; ++x) {
-            int B = ptr[x * 3];
-            int G = ptr[x * 3 + 1];
-            int R = ptr[x * 3 + 2];
-
-            float scale_B = 1 - (abs(B - 127)/127.0f);
-            float scale_G = 1 - (abs(G - 127)/127.0f);
-            float scale_R = 1 - (abs(R - 127)/127.0f);
-
-            R -= static_cast<int>(difference_R*scale_R*strength);
-            G -= static_cast<int>(difference_G*scale_G*strength);
-            B -= static_cast<int>(difference_B*scale_B*strength);
-
-            if (R > 255) R = 255;
-            if (G > 255) G = 255;
-            if (B > 255) B = 255;
-
-            if (R < 0) R = 0;
-            if (G < 0) G = 0;
-            if (B < 0) B = 0;
-
-            ptr[x * 3] = static_cast<uchar>(B);
-            ptr[x * 3 + 1] = static_cast<uchar>(G);
-            ptr[x * 3 + 2] = static_cast<uchar>(R);
-        }
-    }
-
-    out = mat.clone();
+	cv::Mat lut;
+	white_balance_lut(mat, step, prior, lut);
+	return lut;
 }
 
-void normalize_t(cv::Mat original, cv::Scalar goalValues, cv::Point c1, cv::Point c2)
+void balance_white(cv::Mat mat) noexcept
 {
+	cv::LUT(mat, white_balance_lut(mat, WB_SAMPLE_STEP), mat);
+}
+
 /*
-    Provided the goal values, the image will be normalized by comparing them
-    to the average color of a selected region.
+    Mean colour of the non-black pixels of frame inside rect, seen through
+    lut if one is given, and the ratio of pixels left out. Returns false if
+    every pixel is black or rect lies outside the frame.
 */
-    cv::Rect cutoutRect(c1, c2);
-    cv::Mat mat = original(cutoutRect);
+static bool region_mean(const cv::Mat& frame, cv::Rect rect, const cv::Mat& lut, cv::Scalar& values, float& rat) noexcept
+{
+    rect &= cv::Rect(0, 0, frame.cols, frame.rows);
+    rat = 1;
+    if (rect.area() == 0) return false;
+    const cv::Mat region = frame(rect);
 
     long total[3];
     total[0] = 0;
@@ -230,119 +272,302 @@ void normalize_t(cv::Mat original, cv::Scalar goalValues, cv::Point c1, cv::Poin
 
     int removed = 0;
 
-    for (int y = 0; y < mat.rows; ++y) {
-        uchar* ptr = mat.ptr<uchar>(y);
-        for (int x = 0; x < mat.cols; ++x) {
-            if(ptr[x * 3]+ptr[x * 3 + 1]+ptr[x * 3 + 2] < 9) removed++; //if black
+    const int cn = region.channels();
+    const uchar* m = lut.empty() ? IDENTITY.of(cn) : lut.ptr<uchar>(0);
+    for (int y = 0; y < region.rows; ++y) {
+        const uchar* ptr = region.ptr<uchar>(y);
+        for (int x = 0; x < region.cols; ++x, ptr += cn) {
+            int b = m[ptr[0] * cn];
+            int g = m[ptr[1] * cn + 1];
+            int r = m[ptr[2] * cn + 2];
+            if(b+g+r < 9) removed++; //if black
             else
             {
-                total[0] += ptr[x * 3 + 0];
-                total[1] += ptr[x * 3 + 1];
-                total[2] += ptr[x * 3 + 2];
+                total[0] += b;
+                total[1] += g;
+                total[2] += r;
             }
         }
     }
 
-    int R = total[2]/(mat.rows*mat.cols - removed);
-    int G = total[1]/(mat.rows*mat.cols - removed);
-    int B = total[0]/(mat.rows*mat.cols - removed);
+    const int pixels = region.rows*region.cols;
+    rat = (float)removed/pixels; //ratio of discarded pixels
+    if (removed == pixels) return false;
 
-    float rat = (float)removed/(mat.rows*mat.cols); //ratio of discarded pixels
+    int B = total[0]/(pixels - removed);
+    int G = total[1]/(pixels - removed);
+    int R = total[2]/(pixels - removed);
+    values = cv::Scalar(B,G,R);
+    return true;
+}
+
+void normalization_frame_lut(const cv::Mat& frame, cv::Mat& lut, cv::Mat& stage) noexcept
+{
+    /*
+        The whole of normalize_t(in, out) as a single table: dark frames are
+        brightened and white balanced until the reference region is bright
+        enough, then shifted towards the goal values. Statistics of the
+        corrected frame are taken through the table built so far, so no
+        intermediate image is produced. stage holds one step at a time.
+    */
+    const int cn = frame.channels();
+    const cv::Rect region(c_1, c_2);
+    const cv::Scalar goal(GOAL_B, GOAL_G, GOAL_R);
+    cv::Scalar values;
+    float rat;
+
+    identity_lut(cn, lut);
+    if(!region_mean(frame, region, cv::Mat(), values, rat)) return;
+
+    for (int pass = 0; pass < NORMALIZE_DARK_PASSES; ++pass) {
+        cv::Scalar difference = values - goal;
+        if (difference(0) + difference(1) + difference(2) >= -60) break;
+
+        brightness_lut(cn, stage);
+        compose_lut(lut, stage);
+        white_balance_lut(frame, WB_SAMPLE_STEP, lut, stage);
+        compose_lut(lut, stage);
+        if(!region_mean(frame, region, lut, values, rat)) return;
+    }
 
-    if(rat > 0.9)
+    float strength = 0.8f + (1-2*rat);
+    normalization_lut(values - goal, strength, cn, stage);
+    compose_lut(lut, stage);
+}
+
+cv::Mat normalization_frame_lut(const cv::Mat& frame) noexcept
+{
+    cv::Mat lut, stage;
+    normalization_frame_lut(frame, lut, stage);
+    return lut;
+}
+
+void normalize_image(const cv::Mat& in, cv::Mat& out, cv::Scalar values, cv::Scalar goal, float strength) noexcept
+{
+    int difference_B = static_cast<int>(values(0) - goal(0));
+    int difference_G = static_cast<int>(values(1) - goal(1));
+    int difference_R = static_cast<int>(values(2) - goal(2));
+
+    //std::cout << difference_B + difference_G + difference_R  << std::endl;
+    if (difference_B + difference_G + difference_R < -60)
+    {
+        // brighten, balance white and normalize towards the default values
+        cv::LUT(in, normalization_frame_lut(in), out);
+        return;
+    }
+
+    cv::LUT(in, normalization_lut(cv::Scalar(difference_B, difference_G, difference_R), strength, in.channels()), out);
+}
+
+void normalize_t(const cv::Mat& in, cv::Mat& out, cv::Scalar goalValues, cv::Point c1, cv::Point c2)
+{
+/*
+    Provided the goal values, the image will be normalized by comparing them
+    to the average color of a selected region.
+*/
+    cv::Rect cutoutRect(c1, c2);
+    cv::Scalar values;
+    float rat;
+
+    if(!region_mean(in, cutoutRect, cv::Mat(), values, rat) || rat > 0.9)
     {
         std::cerr << "Image too dark/wrong area selected." << std::endl;
+        if (out.data != in.data) in.copyTo(out);
         return;
     }
 
     float strength = 0.8f + (1-2*rat);
-    normalize_image(original, original, cv::Scalar(B,G,R), goalValues, strength);
+    normalize_image(in, out, values, goalValues, strength);
 }
 
-void normalize_t(cv::Mat original)
+void normalize_t(const cv::Mat& in, cv::Mat& out)
 {
     /*
         Normalize the picture towards default values.
     */
     cv::Rect cutoutRect(c_1, c_2);
-    cv::Mat mat = original(cutoutRect);
+    cv::Scalar values;
+    float rat;
 
-    long total[3];
-    total[0] = 0;
-    total[1] = 0;
-    total[2] = 0;
-
-    int removed = 0;
-
-    for (int y = 0; y < mat.rows; ++y) {
-        uchar* ptr = mat.ptr<uchar>(y);
-        for (int x = 0; x < mat.cols; ++x) {
-            if(ptr[x * 3]+ptr[x * 3 + 1]+ptr[x * 3 + 2] < 9) removed++; //if black
-            else
-            {
-                total[0] += ptr[x * 3 + 0];
-                total[1] += ptr[x * 3 + 1];
-                total[2] += ptr[x * 3 + 2];
-            }
-        }
+    if(!region_mean(in, cutoutRect, cv::Mat(), values, rat))
+    {
+        if (out.data != in.data) in.copyTo(out);
+        return;
     }
-
-    int R = total[2]/(mat.rows*mat.cols - removed);
-    int G = total[1]/(mat.rows*mat.cols - removed);
-    int B = total[0]/(mat.rows*mat.cols - removed);
-
-    float rat = (float)removed/(mat.rows*mat.cols);
     float strength = 0.8f + (1-2*rat);
 
     //std::cout << "strength: " << strength << std::endl;
     //std::cout << "pixels not considered: " << rat*100 << "%. " << std::endl;
 
-    normalize_image(original, original, cv::Scalar(B,G,R), cv::Scalar(GOAL_B, GOAL_G, GOAL_R), strength);
+    normalize_image(in, out, values, cv::Scalar(GOAL_B, GOAL_G, GOAL_R), strength);
 }
 
-void normalize_t(cv::Mat mat, cv::Scalar difference, float strength)
+void normalize_t(const cv::Mat& in, cv::Mat& out, cv::Scalar difference, float strength)
 {
     /*
         Normalize the picture towards known values with
         a chosen multiplier parameter.
     */
-    cv::Mat out = mat.clone();
-
-    int difference_R = static_cast<int>(difference(2));
-    int difference_G = static_cast<int>(difference(1));
-    int difference_B = static_cast<int>(difference(0));
-
-    for (int y = 0; y < mat.rows; ++y) {
-        uchar* ptr = mat.ptr<uchar>(y);
-        uchar* ptr_out = out.ptr<uchar>(y);
-        for (int x = 0; x < mat.cols; ++x) {
-            int B = ptr[x * 3];
-            int G = ptr[x * 3 + 1];
-            int R = ptr[x * 3 + 2];
-
-            float scale_B = 1 - (abs(B - 127)/127.0f);
-            float scale_G = 1 - (abs(G - 127)/127.0f);
-            float scale_R = 1 - (abs(R - 127)/127.0f);
-
-            R -= static_cast<int>(difference_R*scale_R*strength);
-            G -= static_cast<int>(difference_G*scale_G*strength);
-            B -= static_cast<int>(difference_B*scale_B*strength);
-
-            if (R > 255) R = 255;
-            if (G > 255) G = 255;
-            if (B > 255) B = 255;
-
-            if (R < 0) R = 0;
-            if (G < 0) G = 0;
-            if (B < 0) B = 0;
-
-            ptr_out[x * 3] = static_cast<uchar>(B);
-            ptr_out[x * 3 + 1] = static_cast<uchar>(G);
-            ptr_out[x * 3 + 2] = static_cast<uchar>(R);
+    cv::LUT(in, normalization_lut(difference, strength, in.channels()), out);
+}
+
+Normalizer::Normalizer(int period, double change) noexcept :
+    m_period(period > 0 ? period : 1), m_change(change), m_age(0), m_refreshed(false), m_reference(), m_lut(), m_stage()
+{
+}
+
+void Normalizer::apply(const cv::Mat& in, cv::Mat& out) noexcept
+{
+    /*
+        Only the reference region is read on every frame; the full
+        statistics are recomputed when it changes or the table gets old.
+        Both tables are kept, so after the first frame nothing is allocated
+        as long as out keeps its size and type.
+    */
+    cv::Scalar values;
+    float rat;
+    bool valid = region_mean(in, cv::Rect(c_1, c_2), cv::Mat(), values, rat);
+
+    m_refreshed = m_lut.empty() || m_lut.channels() != in.channels() || ++m_age >= m_period;
+    for (int c = 0; valid && c < 3; ++c)
+        if (std::abs(values(c) - m_reference(c)) > m_change) m_refreshed = true;
+
+    if (m_refreshed)
+    {
+        normalization_frame_lut(in, m_lut, m_stage);
+        m_reference = values;
+        m_age = 0;
+    }
+    cv::LUT(in, m_lut, out);
+}
+
+void Normalizer::apply(cv::Mat& mat) noexcept
+{
+    apply(mat, mat);
+}
+
+bool Normalizer::refreshed() const noexcept
+{
+    return m_refreshed;
+}
+
+/*
+    Fixed-point reciprocals used by OpenCV for 8-bit BGR to HSV, so that
+    HsvRange classifies every colour exactly as cvtColor converts it.
+*/
+#define HSV_SHIFT 12
+
+struct HsvDivisions
+{
+    int s[256];
+    int h[256];
+
+    HsvDivisions() noexcept
+    {
+        s[0] = h[0] = 0;
+        for (int i = 1; i < 256; ++i) {
+            s[i] = cv::saturate_cast<int>((255 << HSV_SHIFT)/(1.*i));
+            h[i] = cv::saturate_cast<int>((180 << HSV_SHIFT)/(6.*i));
         }
     }
+};
+
+static const HsvDivisions HSV_DIV;
 
-    mat = out.clone();
+HsvRange::HsvRange() noexcept :
+    m_low(-1, -1, -1), m_high(-1, -1, -1), m_hue(), m_saturation()
+{
+}
+
+void HsvRange::set(cv::Scalar low, cv::Scalar high) noexcept
+{
+    if (!m_hue.empty() && low == m_low && high == m_high) return;
+    m_low = low;
+    m_high = high;
+
+    // inRange rounds the bounds to the type of the image
+    int lo[3], hi[3];
+    for (int c = 0; c < 3; ++c) {
+        lo[c] = cvRound(low[c]);
+        hi[c] = cvRound(high[c]);
+    }
+
+    m_hue.create(1, 256, CV_8UC1);
+    uchar* hue = m_hue.ptr<uchar>();
+    for (int h = 0; h < 256; ++h)
+        hue[h] = (h >= lo[0] && h <= hi[0]) ? 255 : 0;
+
+    m_saturation.create(256, 256, CV_8UC1);
+    for (int v = 0; v < 256; ++v) {
+        uchar* sv = m_saturation.ptr<uchar>(v);
+        const bool value = v >= lo[2] && v <= hi[2];
+        for (int diff = 0; diff < 256; ++diff) {
+            int s = (diff*HSV_DIV.s[v] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+            sv[diff] = (value && diff <= v && s >= lo[1] && s <= hi[1]) ? 255 : 0;
+        }
+    }
+}
+
+void HsvRange::apply(const cv::Mat& in, cv::Mat& mask) const noexcept
+{
+    const int cn = in.channels();
+    mask.create(in.rows, in.cols, CV_8UC1);
+    const uchar* hue = m_hue.ptr<uchar>();
+    const uchar* sv = m_saturation.ptr<uchar>();
+
+    for (int y = 0; y < in.rows; ++y) {
+        const uchar* ptr = in.ptr<uchar>(y);
+        uchar* out = mask.ptr<uchar>(y);
+        for (int x = 0; x < in.cols; ++x, ptr += cn) {
+            const int b = ptr[0], g = ptr[1], r = ptr[2];
+            const int v = std::max(b, std::max(g, r));
+            const int diff = v - std::min(b, std::min(g, r));
+            if (!sv[v*256 + diff]) {
+                out[x] = 0;
+                continue;
+            }
+            const int vr = (v == r) ? -1 : 0;
+            const int vg = (v == g) ? -1 : 0;
+            int h = (vr & (g - b)) + (~vr & ((vg & (b - r + 2*diff)) + (~vg & (r - g + 4*diff))));
+            h = (h*HSV_DIV.h[diff] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+            h += (h < 0) ? 180 : 0;
+            out[x] = hue[h];
+        }
+    }
+}
+
+// One pixel as cvtColor to COLOR_BGR2HSV converts it.
+static inline void toHsv(int b, int g, int r, int &h, int &s, int &v) noexcept
+{
+    v = std::max(b, std::max(g, r));
+    const int diff = v - std::min(b, std::min(g, r));
+    s = (diff*HSV_DIV.s[v] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+    const int vr = (v == r) ? -1 : 0;
+    const int vg = (v == g) ? -1 : 0;
+    h = (vr & (g - b)) + (~vr & ((vg & (b - r + 2*diff)) + (~vg & (r - g + 4*diff))));
+    h = (h*HSV_DIV.h[diff] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+    h += (h < 0) ? 180 : 0;
+}
+
+cv::Scalar meanHsv(const cv::Mat& frame, cv::Rect area) noexcept
+{
+    area &= cv::Rect(0, 0, frame.cols, frame.rows);
+    if (area.empty()) return cv::Scalar();
+
+    const int cn = frame.channels();
+    int sum[3] = {0, 0, 0};
+    for (int y = area.y; y < area.y + area.height; ++y) {
+        const uchar* ptr = frame.ptr<uchar>(y) + area.x*cn;
+        for (int x = 0; x < area.width; ++x, ptr += cn) {
+            int h, s, v;
+            toHsv(ptr[0], ptr[1], ptr[2], h, s, v);
+            sum[0] += h;
+            sum[1] += s;
+            sum[2] += v;
+        }
+    }
+    const double n = area.area();
+    return cv::Scalar(sum[0]/n, sum[1]/n, sum[2]/n);
 }
 
 bool isWithin(cv::Scalar hsv, cv::Scalar hsv_min, cv::Scalar hsv_max) noexcept
@@ -15,19 +15,92 @@
 #define GOAL_G 63
 #define GOAL_B 42
 
+#define WB_SAMPLE_STEP 4
+
+#define MASK_OPENING 4 // radius of the square that cleanMask opens with
+
+#define MARKER_SIZE 100 // side of a Pupil surface marker in the display border
+
+#define NORMALIZE_PERIOD 30
+#define NORMALIZE_CHANGE 8
+#define NORMALIZE_DARK_PASSES 3
+
 #define c_1 cv::Point(285,364)
 #define c_2 cv::Point(347,400)
 
 bool isWithin(cv::Scalar, cv::Scalar, cv::Scalar) noexcept;
 cv::Mat cleanMask(cv::Mat) noexcept;
+// For masks that are already 0 or 255; out is only reallocated on a size change.
+void cleanMask(const cv::Mat&, cv::Mat&) noexcept;
 void balance_white(cv::Mat) noexcept;
+void white_balance_lut(const cv::Mat&, int, const cv::Mat&, cv::Mat&) noexcept;
+cv::Mat white_balance_lut(const cv::Mat&, int, const cv::Mat& = cv::Mat()) noexcept;
 void increase_brightness(cv::Mat) noexcept;
-void normalize_t(cv::Mat, cv::Scalar, cv::Point, cv::Point);
-void normalize_t(cv::Mat, cv::Scalar, float);
-void normalize_t(cv::Mat);
-void normalize_image(cv::Mat, cv::Mat, cv::Scalar, cv::Scalar, float) noexcept;
-cv::Mat add_markers(cv::Mat) noexcept;
+void brightness_lut(int, cv::Mat&) noexcept;
+cv::Mat brightness_lut(int) noexcept;
+void normalization_lut(cv::Scalar, float, int, cv::Mat&) noexcept;
+cv::Mat normalization_lut(cv::Scalar, float, int) noexcept;
+void compose_lut(cv::Mat&, const cv::Mat&) noexcept;
+void normalization_frame_lut(const cv::Mat&, cv::Mat&, cv::Mat&) noexcept;
+cv::Mat normalization_frame_lut(const cv::Mat&) noexcept;
+// The normalizations write to out, which may be in itself; out is only
+// reallocated when its size or type differs from in.
+void normalize_t(const cv::Mat&, cv::Mat&, cv::Scalar, cv::Point, cv::Point);
+void normalize_t(const cv::Mat&, cv::Mat&, cv::Scalar, float);
+void normalize_t(const cv::Mat&, cv::Mat&);
+void normalize_image(const cv::Mat&, cv::Mat&, cv::Scalar, cv::Scalar, float) noexcept;
+// Paints the four Pupil surface markers into the corners of a frame that
+// already has a MARKER_SIZE border on the left and right.
+void add_markers(cv::Mat&) noexcept;
+// A grey display buffer for a width x height view with the markers around it.
 cv::Mat create_border_image(int, int);
 
+/*
+    Applies the normalize_t(cv::Mat) correction as one fused table. The table
+    is rebuilt every `period` frames, or earlier when the mean of the
+    reference region moves by more than `change` levels in any channel.
+*/
+class Normalizer
+{
+ public:
+    Normalizer(int period = NORMALIZE_PERIOD, double change = NORMALIZE_CHANGE) noexcept;
+    void apply(const cv::Mat&, cv::Mat&) noexcept;
+    void apply(cv::Mat&) noexcept;
+    bool refreshed() const noexcept;
+
+ private:
+    int m_period;
+    double m_change;
+    int m_age;
+    bool m_refreshed;
+    cv::Scalar m_reference;
+    cv::Mat m_lut;
+    cv::Mat m_stage;
+};
+
+/*
+    Marks the pixels of a BGR or BGRA image whose HSV value lies within
+    [low, high], as cvtColor to COLOR_BGR2HSV followed by inRange would, in
+    a single pass without the intermediate images. The range is compiled
+    into tables by set(), which only rebuilds them when the range changes.
+*/
+class HsvRange
+{
+ public:
+    HsvRange() noexcept;
+    void set(cv::Scalar low, cv::Scalar high) noexcept;
+    void apply(const cv::Mat&, cv::Mat&) const noexcept;
+
+ private:
+    cv::Scalar m_low;
+    cv::Scalar m_high;
+    cv::Mat m_hue;         // 1x256: hue within range
+    cv::Mat m_saturation;  // 256x256 by value and max-min: saturation and value within range
+};
+
+// Mean HSV of a rectangle of a BGR or BGRA frame, converting only its pixels
+// as cvtColor to COLOR_BGR2HSV would.
+cv::Scalar meanHsv(const cv::Mat&, cv::Rect) noexcept;
+
 
 #endif // KIWI-IMAGE-PROCESSING_HPP_INCLUDED
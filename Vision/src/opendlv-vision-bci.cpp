@@ -15,317 +15,133 @@
 
 #include "cluon-complete.hpp"
 #include "opendlv-standard-message-set.hpp"
+#include "action-output.hpp"
 #include "kiwi-image-processing.hpp"
+#include "seqlock.hpp"
+#include "shared-frame.hpp"
+#include "spsc-queue.hpp"
+#include "target-selection.hpp"
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <cstdio>
 #include <iostream>
 #include <memory>
-#include <mutex>
+#include <thread>
+#include <vector>
 
-#define MARKER_SIZE 100
-#define HORIZON(a) static_cast<uint16_t>(a/2-10)
+#define FRAME_SLOTS 6
+#define STAGE_IDLE_US 200
+#define SNAPSHOT_PERIOD_MS 1000
+#define ACTION_REPORT_MS 5000
+#define INPUT_STALE_MS 500 // gaze or EEG readings older than this are not acted on
 
-#define ARRIVED 0.65
-
-#define T_BELOW(a) (int)(a * 0.7)
-#define T_ABOVE(a) (int)(a * 0.12)
-#define T_LEFT(a) (int)(a * 0.10)
-#define T_RIGHT(a) a - T_LEFT(a)
-
-#define FOLLOWING 1
-#define FIND_NEW 0
-
-#define MODE_TARGET 1
-#define MODE_SIMPLE 0
-
-#define STATIONARY 0
-#define RIGHT_TURN 1
-#define LEFT_TURN 2
-#define MOVE_BACKWARDS 10
-
-#define DIRECTIONAL 13
-
-std::mutex mouseMutex;
 //using namespace cv;
 
-struct Args
+/*
+    A frame on its way from the capture stage through processing to the
+    display, with what the display needs to draw on top of it. The image
+    stays at camera resolution; x and y are in display pixels, t and roi
+    in camera pixels.
+*/
+struct Frame
 {
+    cv::Mat img;
+    cv::Mat mask;
     uint16_t x;
     uint16_t y;
-    const uint16_t WIDTH;
-    const uint16_t HEIGHT;
-    uint16_t action;
-    cv::Mat frame;
-    cv::Mat hsv_mat;
-    cv::Scalar hsv_scalar;
-    cv::Rect t;
-    bool fixation;
     bool active;
-    bool potential;
-    bool MODE;
-    bool SELECTION_MODE;
-    const bool VERBOSE;
-    const bool VISUALIZE;
-    const bool MASKVIEW;
-    float angle;
-
-    Args(bool T_MODE, bool T_VERBOSE, bool T_VISUALIZE, bool T_MASKVIEW, uint16_t width, uint16_t height) :
-            WIDTH(width), HEIGHT(height), MODE(T_MODE), x(0), y(0), fixation(0), active(0), action(0),
-            SELECTION_MODE(FIND_NEW), potential(0), angle(0), MASKVIEW(T_MASKVIEW), VERBOSE(T_VERBOSE), VISUALIZE(T_VISUALIZE) {}
+    bool following;
+    cv::Rect t;
+    cv::Rect roi;
+    std::vector<cv::Rect> targets; // tracked but not followed
+
+    Frame() :
+        img(), mask(), x(0), y(0), active(false), following(false), t(), roi(), targets() {}
 };
 
-struct MouseArgs
+/*
+    The latest gaze, fixation and EEG readings with the time each arrived,
+    in display pixels. Written by the OD4 callbacks, or by the mouse
+    callback instead of them, and read as a whole by the processing stage.
+*/
+struct Inputs
 {
     uint16_t x;
     uint16_t y;
-    bool fixation;
     bool active;
+    bool fixation;
+    float potential;
+    std::chrono::steady_clock::time_point gazeTime;
+    std::chrono::steady_clock::time_point fixationTime;
+    std::chrono::steady_clock::time_point eegTime;
 
-    MouseArgs() :
-        x(0), y(0), fixation(false), active(false) {}
+    Inputs() :
+        x(0), y(0), active(false), fixation(false), potential(0), gazeTime(), fixationTime(), eegTime() {}
 };
 
 static void onMouse(int event, int x, int y, int flags, void* param)
 {
-    std::lock_guard<std::mutex> lock(mouseMutex);
-    MouseArgs* parameters = reinterpret_cast<MouseArgs*>(param);
-    parameters->x = x;
-    parameters->y = y;
-
-    if(event == cv::EVENT_LBUTTONDOWN) parameters->fixation = true;
-    if(event == cv::EVENT_LBUTTONUP) parameters->fixation = false;
-
-    parameters->active = true;
+    Seqlock<Inputs>* inputs = reinterpret_cast<Seqlock<Inputs>*>(param);
+    auto now = std::chrono::steady_clock::now();
+    inputs->update([&](Inputs &in){
+        in.x = static_cast<uint16_t>(x);
+        in.y = static_cast<uint16_t>(y);
+        in.active = true;
+        in.gazeTime = now;
+        if(event == cv::EVENT_LBUTTONDOWN) in.fixation = true;
+        if(event == cv::EVENT_LBUTTONUP) in.fixation = false;
+        if(event == cv::EVENT_LBUTTONDOWN || event == cv::EVENT_LBUTTONUP) in.fixationTime = now;
+    });
 }
 
-void defaultValues(Args* p)
+/*
+    Writes a monitoring snapshot; the format follows the file extension.
+    The image goes to a temporary file first and is renamed into place, so
+    a viewer polling the file never sees half of it.
+*/
+static bool writeSnapshot(const std::string &path, const cv::Mat &view, cv::Mat &bgr)
 {
-    uint16_t WIDTH = p->WIDTH;
-    uint16_t HEIGHT = p->HEIGHT;
-    uint16_t maximum_x = p->WIDTH/2 - T_LEFT(WIDTH);
-    uint16_t maximum_y = p->HEIGHT/2 - T_BELOW(HEIGHT);
-
-    p->angle = p->x/(float)WIDTH;
-    p->action = DIRECTIONAL;
-    if (p->VERBOSE) std::cout << "Angle: " << p->angle << std::endl;
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos) return false;
+    std::string temporary = path.substr(0, dot) + ".tmp" + path.substr(dot);
+
+    cv::cvtColor(view, bgr, cv::COLOR_BGRA2BGR); // JPEG has no alpha channel
+    if (!cv::imwrite(temporary, bgr)) return false;
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
 }
 
-void findObject(Args* p)
+// Size of the envelope that od4.send() puts on the wire for a message.
+template <typename T>
+static size_t wireBytes(T &message)
 {
-    uint16_t WIDTH = p->WIDTH;
-    uint16_t HEIGHT = p->HEIGHT;
-    uint16_t x = p->x;
-    uint16_t y = p->y;
-
-    //cv::Rect t;
-    cvtColor(p->frame, p->hsv_mat, cv::COLOR_BGRA2BGR);
-    cvtColor(p->hsv_mat, p->hsv_mat, cv::COLOR_BGR2HSV);
-    cv::Mat mask = cv::Mat::zeros(p->frame.rows, p->frame.cols, CV_8UC1);
-    cv::Mat mask_temp = mask.clone();
-    cv::Scalar offset = cv::Scalar(15,25,25);
-    if(p->hsv_scalar[1] <= 30) offset = cv::Scalar(255, 30, 255); //grey
-    if(p->hsv_scalar[2] <= 50 || p->hsv_scalar[2] >= 230) offset = cv::Scalar(255, 255, 40); //black, white
-    inRange(p->hsv_mat, p->hsv_scalar - offset, p->hsv_scalar + offset, mask);
-    cv::Rect selection(0, 0, p->WIDTH, T_BELOW(HEIGHT));
-    mask = mask(selection);
-    mask = cleanMask(mask);
-
-    if(p->MASKVIEW) cv::imshow("Debug", mask);
-    cv::waitKey(1);
-
-    //if the selection is not within a now cleaned mask – discard:
-    if (p->SELECTION_MODE == FIND_NEW && mask.at<uchar>(x, y) == 0)
-    {
-        if (p->VERBOSE) std::cout << "No object" << std::endl;
-        return;
-    }
-    
-    std::vector<std::vector<cv::Point>> contours;
-    std::vector<cv::Vec4i> hierarchy;
-    double maxSize = 0;
-    int iLabel = 0;
-
-    findContours(mask, contours, hierarchy, cv::RETR_CCOMP, cv::CHAIN_APPROX_SIMPLE);
-
-    if (contours.size() == 0)
-    {
-      p->SELECTION_MODE = FIND_NEW;
-    }
-    else if (p->SELECTION_MODE == FOLLOWING) //already following...
-    {
-        for (int i = 0; i < contours.size(); i++)
-        {
-            double area = cv::contourArea(contours[i], false);
-            if (area > WIDTH*2)
-            {
-               if (area > maxSize)
-               {
-                 maxSize = area;
-                 iLabel = i;
-               }
-            }
-        }
-        drawContours(mask_temp, contours, iLabel, cv::Scalar(255), cv::FILLED, 8, hierarchy);
-        p->t = cv::boundingRect(contours[iLabel]);
-        if(p->VERBOSE) std::cout << "new rectangle: " << p->t.tl() << std::endl;
-    }
-    else
-    {
-        int closest = WIDTH*HEIGHT;
-        for (int i = 0; i < contours.size(); i++)
-        {
-            double area = cv::contourArea(contours[i], false);
-            if (area > WIDTH*2)
-            {
-                //check how close to the selection
-                cv::Rect r = cv::boundingRect(contours[i]);
-                int r_cx = r.x + r.width/2;
-                int r_cy = r.y + r.height/2;
-
-                int selection_distance = (p->x - r_cx)*(p->x - r_cx) + (p->y - r_cy)*(p->y - r_cy);
-                //cout << "distance: " << convertDistance(selection_distance) << endl;
-                if(selection_distance < closest)
-                {
-                    closest = selection_distance;
-                    iLabel = i;
-                    p->t = r;
-                }
-            }
-        }
-        drawContours(mask_temp, contours, iLabel, cv::Scalar(255), cv::FILLED, 8, hierarchy);
-    }
-    
-    if(p->t.height > HEIGHT*ARRIVED) //close enough
-    {
-        if(p->SELECTION_MODE == FOLLOWING)
-        {
-          if(p->VERBOSE) std::cout << "Arrived!" << std::endl;
-          p->action = STATIONARY;
-        }
-        else
-        {
-          if(p->VERBOSE) std::cout << "Reversing" << std::endl;
-          p->action = MOVE_BACKWARDS;
-        }
-        p->SELECTION_MODE = FIND_NEW;
-        return;
-    }
-    else if(p->t.width > WIDTH*0.8) //the area covers most of the field view in width: not an object
-    {
-        if(p->VERBOSE) std::cout << "Not an object. Background?" << std::endl;
-        p->SELECTION_MODE = FIND_NEW;
-        return;
-    }
-
-    //distance = -1;
-    p->SELECTION_MODE = FOLLOWING;
-
-    //finds the point where the object touches the floor
-    /*for (int i = T_BELOW(HEIGHT); i > HORIZON(HEIGHT); --i)
-    {
-        int val = mask_temp.at<uchar>(i, x);
-        if(val != 0)
-        {
-            if (p->VISUALIZE) cv::rectangle(p->frame, cv::Point(x-1, i-1), cv::Point(x+1, i+1), cv::Scalar(30,30,255), -1);
-            //distance = convertDistance(i);
-            break;
-        }
-    }
-
-    if (distance < 0 && p->VERBOSE) std::cout << "Obscured object." << std::endl;*/
-    float position = p->t.tl().x + p->t.width*0.5f;
-    p->angle = position/(float)WIDTH;
-    p->action = DIRECTIONAL;
-    
-    if(p->VERBOSE) std::cout << "The target was found at angle " << p->angle << std::endl;
+    cluon::ToProtoVisitor protoEncoder;
+    cluon::data::Envelope envelope;
+    envelope.dataType(static_cast<int32_t>(message.ID()));
+    message.accept(protoEncoder);
+    envelope.serializedData(protoEncoder.encodedData());
+    envelope.sent(cluon::time::now());
+    envelope.sampleTimeStamp(envelope.sent());
+    envelope.senderStamp(1);
+    return cluon::serializeEnvelope(std::move(envelope)).size();
 }
 
-bool isGround(cv::Scalar hsv) //test values
+static cv::Rect scaled(cv::Rect r, double sx, double sy)
 {
-    cv::Scalar hsv_min = cv::Scalar(10, 35, 10);
-    cv::Scalar hsv_max = cv::Scalar(20, 150, 230);
-
-    return isWithin(hsv, hsv_min, hsv_max);
+    return cv::Rect(cvRound(r.x*sx), cvRound(r.y*sy), cvRound(r.width*sx), cvRound(r.height*sy));
 }
 
-void findAction(Args* p)
+// Draws on the upscaled view; sx and sy scale camera to display pixels.
+static void drawOverlay(const Frame &f, cv::Mat &view, double sx, double sy)
 {
-    if(!(p->active)) return;
-    
-    if((p->fixation || p->potential)) 
+    cv::circle(view, cv::Point(f.x, f.y), 10, cv::Scalar(100, 255, 255), 2);
+    cv::line(view, cv::Point(f.x,0), cv::Point(f.x, view.rows), cv::Scalar(255,255,100));
+    for (const cv::Rect &target : f.targets) cv::rectangle(view, scaled(target, sx, sy), cv::Scalar(255,200,100), 1);
+    if(f.following)
     {
-      uint16_t x = p->x;
-      uint16_t y = p->y;
-      uint16_t WIDTH = p->WIDTH;
-      uint16_t HEIGHT = p->HEIGHT;
-      bool MODE = p->MODE;
-      p->SELECTION_MODE = FIND_NEW;
-
-      if (y < T_ABOVE(HEIGHT))
-      {
-          p->action = MOVE_BACKWARDS;
-          p->angle = 0;
-          if(p->VERBOSE) std::cout << "Back" << std::endl;
-          if(p->VISUALIZE) cv::rectangle(p->frame, cv::Point(0, 0),
-          cv::Point(WIDTH, T_ABOVE(HEIGHT)), cv::Scalar(255,255,255), -1);
-          return;
-      }
-      else if (y > T_BELOW(HEIGHT))
-      {
-          p->action = MOVE_BACKWARDS;
-          p->angle = 0;
-          if(p->VERBOSE) std::cout << "Back" << std::endl;
-          if(p->VISUALIZE) cv::rectangle(p->frame, cv::Point(0, T_BELOW(HEIGHT)),
-          cv::Point(WIDTH, HEIGHT), cv::Scalar(255,255,255), -1);
-          return;
-      }
-      else if (x < T_LEFT(WIDTH))
-      {
-          p->action = LEFT_TURN;
-          if(p->VERBOSE) std::cout << "Left" << std::endl;
-          if(p->VISUALIZE) cv::rectangle(p->frame, cv::Point(0, 0),
-          cv::Point(T_LEFT(WIDTH), HEIGHT), cv::Scalar(255,255,255), -1);
-          return;
-      }
-      else if (x > T_RIGHT(WIDTH))
-      {
-          p->action = RIGHT_TURN;
-          if(p->VERBOSE) std::cout << "Right" << std::endl;
-          if(p->VISUALIZE) cv::rectangle(p->frame, cv::Point(T_RIGHT(WIDTH), 0),
-          cv::Point(WIDTH, HEIGHT), cv::Scalar(255,255,255), -1);
-          return;
-      }
-      else if (MODE == MODE_SIMPLE) //provide angle if the directional mode was selected
-      {
-          defaultValues(p);
-          return;
-      }
-      else if (MODE == MODE_TARGET) { //find object
-        cv::Rect selection(x-4, y-4, 8, 8); //pixel is guaranteed to be away from the border
-        cv::Mat cutout = p->frame(selection);
-
-        cvtColor(cutout, cutout, cv::COLOR_BGRA2BGR);
-        cvtColor(cutout, cutout, cv::COLOR_BGR2HSV);
-        cvtColor(p->frame, p->hsv_mat, cv::COLOR_BGRA2BGR);
-        cvtColor(p->hsv_mat, p->hsv_mat, cv::COLOR_BGR2HSV);
-        cv::Scalar meanvalue = mean(cutout); //mean of the gaze area
-
-        uint16_t h = static_cast<uint16_t>(meanvalue[0]);
-        uint16_t s = static_cast<uint16_t>(meanvalue[1]);
-        uint16_t v = static_cast<uint16_t>(meanvalue[2]);
-
-        p->hsv_scalar = cv::Scalar(h,s,v);
-
-        if(isGround(p->hsv_scalar))
-        {
-            if (p->VERBOSE) std::cout << "Selected the ground or wall." << std::endl; //color to be always ignored, discarded
-            return;
-        }
-        else findObject(p);
-      }
-    }
-    else if (p->SELECTION_MODE == FOLLOWING) { //continue following object
-        findObject(p);
+        cv::rectangle(view, scaled(f.t, sx, sy), cv::Scalar(255,255,255), 1);
+        cv::rectangle(view, scaled(f.roi, sx, sy), cv::Scalar(100,100,100), 1);
     }
 }
 
@@ -337,18 +153,25 @@ int32_t main(int32_t argc, char **argv) {
          (0 == commandlineArguments.count("eeg")) ||
          (0 == commandlineArguments.count("mode")) ) {
         std::cerr << argv[0] << " attaches to a shared memory area containing an ARGB image." << std::endl;
-        std::cerr << "Usage:   " << argv[0] << " --cid=<OD4 session> --name=<name of shared memory area> --mode=<mode of steering> [--verbose] [--mouse] [--markers] [--visualize]" << std::endl;
+        std::cerr << "Usage:   " << argv[0] << " --cid=<OD4 session> --name=<name of shared memory area> --mode=<mode of steering> [--verbose] [--mouse] [--markers] [--visualize] [--headless]" << std::endl;
         std::cerr << "         --cid:    CID of the OD4Session to send and receive messages" << std::endl;
         std::cerr << "         --name:   name of the shared memory area to attach" << std::endl;
-        std::cerr << "         --width:  width of the frame" << std::endl;
-        std::cerr << "         --height: height of the frame" << std::endl;
+        std::cerr << "         --width:  width of the displayed frame; frames are processed at camera resolution" << std::endl;
+        std::cerr << "         --height: height of the displayed frame" << std::endl;
         std::cerr << "	       --mode:   direction {0} or target {1}" << std::endl;
         std::cerr << "	       --eeg:   P300 mV threshold; choose 0 to use eye tracker only" << std::endl;
         std::cerr << "	       --mouse:  (optional) uses mouse instead of the eye tracker and eeg equipment" << std::endl;
         std::cerr << "	       --markers:  (optional) adds Pupil Labs markers to the image" << std::endl;
         std::cerr << "	       --visualize:  (optional) visualizes areas and objects detected" << std::endl;
         std::cerr << "	       --normalize:  (optional) normalizes frames" << std::endl;
+        std::cerr << "	       --normalizeperiod:  (optional) frames between normalization updates; default: " << NORMALIZE_PERIOD << std::endl;
         std::cerr << "	       --maskview:  (optional) view mask for debugging" << std::endl;
+        std::cerr << "	       --headless:  (optional) no windows; for running without a display" << std::endl;
+        std::cerr << "	       --snapshot:  (optional) file to save the view to periodically, .jpg or .png" << std::endl;
+        std::cerr << "	       --snapshotshm:  (optional) shared memory area to publish the view to periodically" << std::endl;
+        std::cerr << "	       --snapshotperiod:  (optional) milliseconds between snapshots; default: " << SNAPSHOT_PERIOD_MS << std::endl;
+        std::cerr << "	       --actionperiod:  (optional) shortest milliseconds between two sent actions; default: " << ACTION_PERIOD_MS << std::endl;
+        std::cerr << "	       --actionrefresh:  (optional) milliseconds after which an unchanged action is sent again; default: " << ACTION_REFRESH_MS << std::endl;
         std::cerr << "Example: " << argv[0] << " --cid=112 --name=img.argb --mode=0 --verbose --mouse --markers --eeg=0 --maskview" << std::endl;
     }
     else {
@@ -358,137 +181,311 @@ int32_t main(int32_t argc, char **argv) {
         const uint16_t EEG{static_cast<uint16_t>(std::stoi(commandlineArguments["eeg"]))};
         const bool VERBOSE{commandlineArguments.count("verbose") != 0};
         const bool MODE{static_cast<bool>(std::stoi(commandlineArguments["mode"]))};
-        const bool MOUSE{commandlineArguments.count("mouse") != 0};
+        const bool HEADLESS{commandlineArguments.count("headless") != 0};
+        const bool MOUSE{commandlineArguments.count("mouse") != 0 && !HEADLESS};
         const bool MARKERS{commandlineArguments.count("markers") != 0};
         const bool VISUALIZE{commandlineArguments.count("visualize") != 0};
         const bool NORMALIZE{commandlineArguments.count("normalize") != 0};
-        const bool MASKVIEW{commandlineArguments.count("maskview") != 0};
-        uint16_t x;
-        uint16_t y;
-        bool active = false;
-        bool fixation = false;
-        bool potential = false;
-        float currentPotential{0};
+        const int NORMALIZE_EVERY{(commandlineArguments.count("normalizeperiod") != 0) ? std::stoi(commandlineArguments["normalizeperiod"]) : NORMALIZE_PERIOD};
+        const bool MASKVIEW{commandlineArguments.count("maskview") != 0 && !HEADLESS};
+        const std::string SNAPSHOT{(commandlineArguments.count("snapshot") != 0) ? commandlineArguments["snapshot"] : ""};
+        const std::string SNAPSHOT_SHM{(commandlineArguments.count("snapshotshm") != 0) ? commandlineArguments["snapshotshm"] : ""};
+        const int SNAPSHOT_EVERY{(commandlineArguments.count("snapshotperiod") != 0) ? std::stoi(commandlineArguments["snapshotperiod"]) : SNAPSHOT_PERIOD_MS};
+        const int ACTION_PERIOD{(commandlineArguments.count("actionperiod") != 0) ? std::stoi(commandlineArguments["actionperiod"]) : ACTION_PERIOD_MS};
+        const int ACTION_REFRESH{(commandlineArguments.count("actionrefresh") != 0) ? std::stoi(commandlineArguments["actionrefresh"]) : ACTION_REFRESH_MS};
+        const bool SNAPSHOTS{!SNAPSHOT.empty() || !SNAPSHOT_SHM.empty()};
+        Seqlock<Inputs> inputs;
+        ActionOutput output(ACTION_PERIOD, ACTION_REFRESH);
+        auto nextActionReport = std::chrono::steady_clock::now() + std::chrono::milliseconds(ACTION_REPORT_MS);
         cv::Mat background;
+        Normalizer normalizer(NORMALIZE_EVERY);
+
+        /*
+            Frames move between the stages as slot numbers: capture takes a
+            free slot, processing passes it on to the display and the display
+            returns it. Every queue can hold all
+            slots, so pushing never fails; a stage that falls behind skips
+            to the newest frame and recycles the rest.
+        */
+        Frame pool[FRAME_SLOTS];
+        SpscQueue<uint8_t, FRAME_SLOTS> toProcess;
+        SpscQueue<uint8_t, FRAME_SLOTS> toDisplay;
+        SpscQueue<uint8_t, FRAME_SLOTS> processed;
+        SpscQueue<uint8_t, FRAME_SLOTS> displayed;
+        for (uint8_t i = 0; i < FRAME_SLOTS; i++) processed.push(i);
+        std::atomic<bool> running{true};
+        const bool DISPLAY{!HEADLESS || SNAPSHOTS}; // whether processed frames go on to the display stage
+
+        if (HEADLESS && commandlineArguments.count("mouse") != 0) std::cout << "Caution: --mouse needs a window; ignored in headless mode." << std::endl;
+        if (HEADLESS && commandlineArguments.count("maskview") != 0) std::cout << "Caution: --maskview needs a window; ignored in headless mode." << std::endl;
         
-        MouseArgs mouseParam;
-        Args param(MODE, VERBOSE, VISUALIZE, MASKVIEW, WIDTH, HEIGHT);
-
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
         std::unique_ptr<cluon::SharedMemory> sharedMemory{new cluon::SharedMemory{NAME}};
         if (sharedMemory && sharedMemory->valid()) {
             std::clog << argv[0] << ": Attached to shared memory '" << sharedMemory->name() << " (" << sharedMemory->size() << " bytes)." << std::endl;
+            SharedFrameReader frames(sharedMemory.get());
+            if (!frames.valid()) return retCode;
+            std::clog << argv[0] << ": Frames of " << frames.size().width << "x" << frames.size().height
+                      << (frames.zeroCopy() ? ", read in place." : ", copied out.") << std::endl;
+
+            // analysis runs on the camera frames; only the display is scaled up
+            const cv::Size CAMERA{frames.size()};
+            const double SCALE_X{static_cast<double>(WIDTH)/CAMERA.width};
+            const double SCALE_Y{static_cast<double>(HEIGHT)/CAMERA.height};
+            Args param(MODE, VERBOSE, VISUALIZE, MASKVIEW, static_cast<uint16_t>(CAMERA.width), static_cast<uint16_t>(CAMERA.height));
+            cv::Mat view;
 
             cluon::OD4Session od4{static_cast<uint16_t>(std::stoi(commandlineArguments["cid"]))};
-            cv::namedWindow("Stream", cv::WINDOW_AUTOSIZE);
-            if(MASKVIEW) cv::namedWindow("Debug", cv::WINDOW_AUTOSIZE);
+            if (!HEADLESS)
+            {
+                cv::namedWindow("Stream", cv::WINDOW_AUTOSIZE);
+                if(MASKVIEW) cv::namedWindow("Debug", cv::WINDOW_AUTOSIZE);
+                if(MARKERS)
+                {
+                    // built once; the display stage scales frames straight into its middle
+                    background = create_border_image(WIDTH, HEIGHT);
+                    view = background(cv::Rect(MARKER_SIZE,0,WIDTH,HEIGHT));
+                }
+            }
 
-            if(MARKERS) background = create_border_image(WIDTH, HEIGHT);
+            // monitoring copies of the view, written by the display stage
+            std::unique_ptr<cluon::SharedMemory> snapshotMemory;
+            std::unique_ptr<SharedFrameWriter> snapshotWriter;
+            if (!SNAPSHOT_SHM.empty())
+            {
+                snapshotMemory.reset(new cluon::SharedMemory{SNAPSHOT_SHM, sharedFrameBytes(WIDTH, HEIGHT)});
+                if (snapshotMemory->valid()) snapshotWriter.reset(new SharedFrameWriter(snapshotMemory.get(), WIDTH, HEIGHT));
+                if (!snapshotWriter || !snapshotWriter->valid())
+                {
+                    std::cout << "Caution: cannot create shared memory '" << SNAPSHOT_SHM << "' for snapshots." << std::endl;
+                    snapshotWriter.reset();
+                }
+            }
+            cv::Mat snapshotBgr;
+            auto nextSnapshot = std::chrono::steady_clock::now();
 
             if(MOUSE) // alternative mode using a mouse pointer
             {
-                cv::setMouseCallback("Stream", onMouse, (void*)&mouseParam);
+                cv::setMouseCallback("Stream", onMouse, (void*)&inputs);
             }
             else // listening for Pupil data
             {
-                std::mutex gazeMutex;
-                auto onGaze = [&gazeMutex, &x, &y, &active, &WIDTH, &HEIGHT, &MARKERS](cluon::data::Envelope &&env){
+                // the OD4 callbacks all run on the session's one receiving thread
+                auto onGaze = [&inputs, &WIDTH, &HEIGHT, &MARKERS](cluon::data::Envelope &&env){
                   auto senderStamp = env.senderStamp();
                   if (senderStamp == 1)
                   {
                     opendlv::logic::sensation::Point gaze = cluon::extractMessage<opendlv::logic::sensation::Point>(std::move(env));
 
-                    std::lock_guard<std::mutex> lck(gazeMutex);
-                    x = static_cast<uint16_t>((WIDTH+(MARKERS*(2*MARKER_SIZE)))*gaze.azimuthAngle());
-                    y = static_cast<uint16_t>(HEIGHT*gaze.zenithAngle());
-                    active = static_cast<bool>(gaze.distance());
+                    inputs.update([&](Inputs &in){
+                        in.x = static_cast<uint16_t>((WIDTH+(MARKERS*(2*MARKER_SIZE)))*gaze.azimuthAngle());
+                        in.y = static_cast<uint16_t>(HEIGHT*gaze.zenithAngle());
+                        in.active = static_cast<bool>(gaze.distance());
+                        in.gazeTime = std::chrono::steady_clock::now();
+                    });
                   }
                 };
 
-                std::mutex fixationMutex;
-                auto onFixation = [&fixationMutex, &fixation](cluon::data::Envelope &&env){
+                auto onFixation = [&inputs](cluon::data::Envelope &&env){
                   opendlv::proxy::SwitchStateReading fixationReading = cluon::extractMessage<opendlv::proxy::SwitchStateReading>(std::move(env));
 
-                  std::lock_guard<std::mutex> lck(fixationMutex);
-                  fixation = fixationReading.state() == 1;
+                  inputs.update([&](Inputs &in){
+                      in.fixation = fixationReading.state() == 1;
+                      in.fixationTime = std::chrono::steady_clock::now();
+                  });
                 };
                 
-                std::mutex eegMutex;
-                auto onEEG = [&eegMutex, &currentPotential, &VERBOSE](cluon::data::Envelope &&env){
+                auto onEEG = [&inputs](cluon::data::Envelope &&env){
                   opendlv::proxy::VoltageReading current = cluon::extractMessage<opendlv::proxy::VoltageReading>(std::move(env));
-                  std::lock_guard<std::mutex> lck(eegMutex);
-                  currentPotential = current.voltage();
+                  inputs.update([&](Inputs &in){
+                      in.potential = current.voltage();
+                      in.eegTime = std::chrono::steady_clock::now();
+                  });
                 };
 
                 od4.dataTrigger(opendlv::logic::sensation::Point::ID(), onGaze);
                 od4.dataTrigger(opendlv::proxy::SwitchStateReading::ID(), onFixation);
-                od4.dataTrigger(opendlv::proxy::SwitchStateReading::ID(), onEEG);
+                od4.dataTrigger(opendlv::proxy::VoltageReading::ID(), onEEG);
             }
 
-            while (od4.isRunning())
-            {
-                if(MOUSE)
+            std::thread capture([&](){
+                cv::Mat stage; // raw frames on their way to the normalizer, and skipped ones
+                uint8_t slot;
+                bool holding = false; // a free slot kept while no frame came
+                while (running && od4.isRunning())
                 {
-                    std::lock_guard<std::mutex> lock(mouseMutex);
-                    x = mouseParam.x;
-                    y = mouseParam.y;
-                    active = mouseParam.active;
-                    fixation = mouseParam.fixation;
-                    potential = fixation;
+                    if (!holding && !processed.pop(slot) && !displayed.pop(slot))
+                    {
+                        cv::Mat skipped;
+                        frames.next(skipped, stage); // every slot busy: skip
+                        continue;
+                    }
+                    holding = true;
+                    Frame &f = pool[slot];
+
+                    // the slots keep their buffers from earlier frames. A raw
+                    // frame is copied under the lock straight into the slot,
+                    // or into the stage when it is normalized; a frame with a
+                    // header is read in place and only ours until the next one
+                    cv::Mat frame;
+                    if (!frames.next(frame, NORMALIZE ? stage : f.img)) continue;
+                    if(NORMALIZE)
+                    {
+                        auto normalizeStart = std::chrono::steady_clock::now();
+                        normalizer.apply(frame, f.img);
+                        if(VERBOSE) std::cout << "Normalization: " << std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - normalizeStart).count() << " us"
+                                              << (normalizer.refreshed() ? " (updated)" : "") << std::endl;
+                    }
+                    else if (frame.data != f.img.data) frame.copyTo(f.img);
+                    holding = false;
+                    toProcess.push(slot);
                 }
+            });
 
-                if(MARKERS) // adding pointer position offset
+            std::thread processing([&](){
+                while (running && od4.isRunning())
                 {
-                    x-=MARKER_SIZE;
-                    if(x>= WIDTH) active = false;
+                    uint8_t slot, newer;
+                    if (!toProcess.pop(slot))
+                    {
+                        std::this_thread::sleep_for(std::chrono::microseconds(STAGE_IDLE_US));
+                        continue;
+                    }
+                    while (toProcess.pop(newer))
+                    {
+                        processed.push(slot);
+                        slot = newer;
+                    }
+                    Frame &f = pool[slot];
+
+                    // one consistent reading of all inputs for this frame
+                    const Inputs input = inputs.load();
+                    const auto now = std::chrono::steady_clock::now();
+                    const auto stale = std::chrono::milliseconds(INPUT_STALE_MS);
+                    uint16_t x = input.x;
+                    uint16_t y = input.y;
+                    bool active = input.active;
+                    bool fixation = input.fixation;
+
+                    // decided afresh each frame, so a past reading never lingers
+                    bool potential = MOUSE ? fixation : (input.potential > EEG && now - input.eegTime <= stale);
+
+                    if(!MOUSE && now - input.gazeTime > stale) active = false; // the eye tracker went quiet
+
+                    if(MARKERS) // adding pointer position offset
+                    {
+                        x-=MARKER_SIZE;
+                        if(x>= WIDTH) active = false;
+                    }
+
+                    param.x = static_cast<uint16_t>(x/SCALE_X); // display to camera pixels
+                    param.y = static_cast<uint16_t>(y/SCALE_Y);
+                    param.active = active;
+                    param.fixation = fixation;
+                    param.potential = potential;
+                    param.frame = f.img;
+
+                    findAction(&param);
+                    updateTargets(&param);
+
+                    if (!active && VERBOSE) std::cout << "Gaze outside of the screen" << std::endl;
+                    if (VERBOSE)
+                    {
+                        auto age = [&now](std::chrono::steady_clock::time_point t){
+                            return std::chrono::duration_cast<std::chrono::milliseconds>(now - t).count(); };
+                        std::cout << "Input age: gaze " << age(input.gazeTime) << " ms, fixation " << age(input.fixationTime)
+                                  << " ms, EEG " << age(input.eegTime) << " ms" << std::endl;
+                    }
+
+                    // sent on change, at most every ACTION_PERIOD, and repeated every ACTION_REFRESH
+                    if (output.offer(param.action, param.angle, now))
+                    {
+                        cluon::data::TimeStamp sampleTime;
+                        opendlv::logic::perception::ObjectDirection selectedAction;
+                        selectedAction.azimuthAngle(param.angle);
+                        selectedAction.objectId(param.action);
+                        if (VERBOSE) output.sent(wireBytes(selectedAction));
+                        od4.send(selectedAction, sampleTime, 1);
+                    }
+                    if (VERBOSE && now >= nextActionReport)
+                    {
+                        output.report(std::cout, now);
+                        nextActionReport = now + std::chrono::milliseconds(ACTION_REPORT_MS);
+                    }
+
+                    f.x = x;
+                    f.y = y;
+                    f.active = active;
+                    f.following = param.SELECTION_MODE == FOLLOWING;
+                    f.t = param.t;
+                    f.roi = param.roi;
+                    f.targets.clear();
+                    for (int i = 0; i < TARGET_SLOTS; i++)
+                        if (param.targets.id[i] != 0 && i != param.selected) f.targets.push_back(param.targets.box[i]);
+                    if(MASKVIEW) param.mask.copyTo(f.mask);
+                    if (DISPLAY) toDisplay.push(slot);
+                    else processed.push(slot);
                 }
-                
-                if(currentPotential > EEG) potential = 1;
+            });
+
+            while (od4.isRunning()) // display stage; HighGUI stays on the main thread
+            {
+                uint8_t slot, newer;
+                if (!toDisplay.pop(slot))
+                {
+                    if (HEADLESS) std::this_thread::sleep_for(std::chrono::milliseconds(DISPLAY ? 1 : 100));
+                    else cv::waitKey(1);
+                    continue;
+                }
+                while (toDisplay.pop(newer))
+                {
+                    displayed.push(slot);
+                    slot = newer;
+                }
+                Frame &f = pool[slot];
 
-                cv::Mat img, view;
-                sharedMemory->wait();
-                sharedMemory->lock();
+                auto now = std::chrono::steady_clock::now();
+                const bool snapshot{SNAPSHOTS && now >= nextSnapshot};
+                if (HEADLESS && !snapshot)
                 {
-                    cv::Mat temp(480,640, CV_8UC4, sharedMemory->data());
-                    img = temp.clone();
+                    displayed.push(slot);
+                    continue;
                 }
-                sharedMemory->unlock();
-                if(NORMALIZE) normalize_t(img);
-                cv::resize(img, view, cv::Size(WIDTH,HEIGHT));
-                
-                param.x = x;
-                param.y = y;
-                param.active = active;
-                param.fixation = fixation;
-                param.potential = potential;
-                param.frame = view;
 
-                findAction(&param);
+                cv::resize(f.img, view, cv::Size(WIDTH,HEIGHT));
+                if (f.active && VISUALIZE) drawOverlay(f, view, SCALE_X, SCALE_Y);
 
-                if (active && VISUALIZE)
+                if (snapshot)
                 {
-                    cv::circle(view, cv::Point(x, y), 10, cv::Scalar(100, 255, 255), 2);
-                    cv::line(view, cv::Point(x,0), cv::Point(x, HEIGHT), cv::Scalar(255,255,100));
-                    if(param.SELECTION_MODE == FOLLOWING) cv::rectangle(view, param.t.tl(), param.t.br(), cv::Scalar(255,255,255), 1);
+                    nextSnapshot = now + std::chrono::milliseconds(SNAPSHOT_EVERY);
+                    if (!SNAPSHOT.empty() && !writeSnapshot(SNAPSHOT, view, snapshotBgr))
+                        std::cout << "Caution: cannot write snapshot " << SNAPSHOT << std::endl;
+                    if (snapshotWriter)
+                    {
+                        cv::Mat target = snapshotWriter->acquire();
+                        view.copyTo(target);
+                        snapshotWriter->publish();
+                    }
                 }
-                else if (!active && VERBOSE) std::cout << "Gaze outside of the screen" << std::endl;
-
-                cluon::data::TimeStamp sampleTime;
-                opendlv::logic::perception::ObjectDirection selectedAction;
-                selectedAction.azimuthAngle(param.angle);
-                selectedAction.objectId(param.action);
-                od4.send(selectedAction, sampleTime, 1);
 
-                if (MARKERS)
+                if (HEADLESS)
                 {
-                    view.copyTo(background(cv::Rect(MARKER_SIZE,0,WIDTH,HEIGHT)));
-                    cv::imshow("Stream", background);
+                    displayed.push(slot);
+                    continue;
                 }
-                else cv::imshow("Stream", view);
+
+                if(MASKVIEW && !f.mask.empty()) cv::imshow("Debug", f.mask);
+
+                cv::imshow("Stream", MARKERS ? background : view);
 
                 cv::waitKey(1);
+                displayed.push(slot);
             }
 
+            running = false;
+            sharedMemory->notifyAll(); // wakes the capture stage
+            capture.join();
+            processing.join();
         }
         retCode = 0;
     }
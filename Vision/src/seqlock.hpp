@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2019  Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SEQLOCK_HPP_INCLUDED
+#define SEQLOCK_HPP_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/*
+    Latest value of T, written by exactly one thread and read by any number
+    of threads without either side blocking. The sequence is odd while a
+    write is in progress; a reader copies the value and retries when the
+    sequence was odd or moved under it, so it always gets one whole write.
+    The value is held in relaxed atomic words, so the copies do not race.
+*/
+template <typename T>
+class Seqlock
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Seqlock copies its value bytewise");
+
+ public:
+    Seqlock() noexcept : m_written(), m_sequence(0)
+    {
+        publish();
+    }
+
+    void store(const T &value) noexcept
+    {
+        m_written = value;
+        publish();
+    }
+
+    // Changes the last stored value in the writer's copy and publishes it.
+    template <typename F>
+    void update(F change) noexcept
+    {
+        change(m_written);
+        publish();
+    }
+
+    T load() const noexcept
+    {
+        uint64_t words[WORDS];
+        uint32_t before, after;
+        do {
+            before = m_sequence.load(std::memory_order_acquire);
+            for (size_t i = 0; i < WORDS; i++) words[i] = m_words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = m_sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+
+        T value;
+        std::memcpy(&value, words, sizeof(T));
+        return value;
+    }
+
+    // Number of values stored so far.
+    uint32_t version() const noexcept
+    {
+        return m_sequence.load(std::memory_order_acquire)/2 - 1;
+    }
+
+ private:
+    Seqlock(const Seqlock &) = delete;
+    Seqlock &operator=(const Seqlock &) = delete;
+
+    static const size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1)/sizeof(uint64_t);
+
+    void publish() noexcept
+    {
+        uint64_t words[WORDS] = {};
+        std::memcpy(words, &m_written, sizeof(T));
+
+        const uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+        m_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; i++) m_words[i].store(words[i], std::memory_order_relaxed);
+        m_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    T m_written;  // the writer's own copy
+    alignas(64) std::atomic<uint32_t> m_sequence;
+    std::atomic<uint64_t> m_words[WORDS];
+};
+
+#endif // SEQLOCK_HPP_INCLUDED
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2019  Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shared-frame.hpp"
+
+#include <cmath>
+#include <iostream>
+
+static uint32_t headerBytes() noexcept
+{
+    return (sizeof(SharedFrameHeader) + SHARED_FRAME_ALIGNMENT - 1)/SHARED_FRAME_ALIGNMENT*SHARED_FRAME_ALIGNMENT;
+}
+
+uint32_t sharedFrameBytes(uint32_t width, uint32_t height, uint32_t buffers) noexcept
+{
+    return headerBytes() + buffers*width*4*height;
+}
+
+/*
+    Geometry of a raw BGRA frame filling the whole area; the camera
+    decoders do not describe their frames, so the common aspect ratios
+    are tried.
+*/
+static cv::Size rawGeometry(uint32_t bytes) noexcept
+{
+    const uint32_t ASPECTS[3][2] = {{4, 3}, {16, 9}, {5, 4}};
+    for (const uint32_t* aspect : ASPECTS)
+    {
+        const uint32_t units = bytes/4/(aspect[0]*aspect[1]);
+        const uint32_t k = static_cast<uint32_t>(std::lround(std::sqrt(static_cast<double>(units))));
+        if (k > 0 && k*k*aspect[0]*aspect[1]*4 == bytes)
+            return cv::Size(static_cast<int>(k*aspect[0]), static_cast<int>(k*aspect[1]));
+    }
+    return cv::Size();
+}
+
+static cv::Mat bufferView(cluon::SharedMemory* memory, const SharedFrameHeader* header, uint32_t index) noexcept
+{
+    char* buffer = memory->data() + header->offset + static_cast<size_t>(index)*header->stride*header->height;
+    return cv::Mat(static_cast<int>(header->height), static_cast<int>(header->width), CV_8UC4, buffer, header->stride);
+}
+
+SharedFrameWriter::SharedFrameWriter(cluon::SharedMemory* memory, uint32_t width, uint32_t height, uint32_t buffers) noexcept :
+    m_memory(memory), m_header(nullptr), m_writing(SHARED_FRAME_NONE)
+{
+    if (m_memory == nullptr || !m_memory->valid()) return;
+    if (buffers < 2 || buffers > SHARED_FRAME_MAX_BUFFERS || m_memory->size() < sharedFrameBytes(width, height, buffers))
+    {
+        std::cout << "Caution: " << m_memory->size() << " bytes of shared memory cannot hold " << buffers << " frames of "
+                  << width << "x" << height << "." << std::endl;
+        return;
+    }
+
+    m_header = reinterpret_cast<SharedFrameHeader*>(m_memory->data());
+    m_memory->lock();
+    m_header->version = SHARED_FRAME_VERSION;
+    m_header->width = width;
+    m_header->height = height;
+    m_header->stride = width*4;
+    m_header->buffers = buffers;
+    m_header->offset = headerBytes();
+    m_header->latest = SHARED_FRAME_NONE;
+    m_header->reading = SHARED_FRAME_NONE;
+    m_header->reserved = 0;
+    m_header->sequence = 0;
+    m_header->magic = SHARED_FRAME_MAGIC;
+    m_memory->unlock();
+}
+
+bool SharedFrameWriter::valid() const noexcept
+{
+    return m_header != nullptr;
+}
+
+cv::Mat SharedFrameWriter::acquire() noexcept
+{
+    /*
+        Prefers a buffer holding neither the newest frame nor the one being
+        read. With two buffers and a slow reader there is none; the newest
+        frame is then withdrawn and overwritten.
+    */
+    if (m_header == nullptr) return cv::Mat();
+
+    m_memory->lock();
+    uint32_t index = SHARED_FRAME_NONE;
+    for (uint32_t i = 0; i < m_header->buffers && index == SHARED_FRAME_NONE; i++)
+        if (i != m_header->reading && i != m_header->latest) index = i;
+    if (index == SHARED_FRAME_NONE)
+    {
+        index = m_header->latest;
+        m_header->latest = SHARED_FRAME_NONE;
+    }
+    m_writing = index;
+    m_memory->unlock();
+
+    return bufferView(m_memory, m_header, index);
+}
+
+void SharedFrameWriter::publish() noexcept
+{
+    if (m_header == nullptr || m_writing == SHARED_FRAME_NONE) return;
+
+    m_memory->lock();
+    m_header->latest = m_writing;
+    m_header->sequence++;
+    m_memory->unlock();
+    m_memory->notifyAll();
+    m_writing = SHARED_FRAME_NONE;
+}
+
+SharedFrameReader::SharedFrameReader(cluon::SharedMemory* memory) noexcept :
+    m_memory(memory), m_header(nullptr), m_size(), m_copy(), m_sequence(0), m_dropped(0)
+{
+    if (m_memory == nullptr || !m_memory->valid()) return;
+
+    const uint32_t bytes = m_memory->size();
+    SharedFrameHeader* header = reinterpret_cast<SharedFrameHeader*>(m_memory->data());
+    m_memory->lock();
+    if (bytes >= sizeof(SharedFrameHeader) && header->magic == SHARED_FRAME_MAGIC && header->version == SHARED_FRAME_VERSION
+        && header->buffers >= 2 && header->buffers <= SHARED_FRAME_MAX_BUFFERS && header->stride >= header->width*4
+        && static_cast<uint64_t>(header->offset) + static_cast<uint64_t>(header->buffers)*header->stride*header->height <= bytes)
+    {
+        m_header = header;
+        m_size = cv::Size(static_cast<int>(header->width), static_cast<int>(header->height));
+    }
+    m_memory->unlock();
+
+    if (m_header == nullptr)
+    {
+        m_size = rawGeometry(bytes);
+        if (m_size.area() == 0) std::cout << "Caution: cannot tell the frame size of " << bytes << " bytes of shared memory." << std::endl;
+    }
+}
+
+SharedFrameReader::~SharedFrameReader() noexcept
+{
+    if (m_header == nullptr) return;
+
+    m_memory->lock();
+    m_header->reading = SHARED_FRAME_NONE;
+    m_memory->unlock();
+}
+
+bool SharedFrameReader::valid() const noexcept
+{
+    return m_size.area() > 0;
+}
+
+bool SharedFrameReader::zeroCopy() const noexcept
+{
+    return m_header != nullptr;
+}
+
+cv::Size SharedFrameReader::size() const noexcept
+{
+    return m_size;
+}
+
+bool SharedFrameReader::take(cv::Mat& frame, cv::Mat& buffer) noexcept
+{
+    // Called with the shared memory locked.
+    if (m_header == nullptr)
+    {
+        cv::Mat raw(m_size, CV_8UC4, m_memory->data());
+        raw.copyTo(buffer);
+        frame = buffer;
+        m_sequence++;
+        return true;
+    }
+
+    if (m_header->latest == SHARED_FRAME_NONE || m_header->sequence == m_sequence) return false;
+
+    if (m_sequence != 0 && m_header->sequence > m_sequence + 1) m_dropped += m_header->sequence - m_sequence - 1;
+    m_sequence = m_header->sequence;
+    m_header->reading = m_header->latest;
+    frame = bufferView(m_memory, m_header, m_header->reading);
+    return true;
+}
+
+bool SharedFrameReader::acquire(cv::Mat& frame) noexcept
+{
+    return acquire(frame, m_copy);
+}
+
+bool SharedFrameReader::acquire(cv::Mat& frame, cv::Mat& buffer) noexcept
+{
+    /*
+        Takes the newest frame without waiting. A frame handed out earlier
+        stays valid until the next successful call. A raw frame is copied
+        into buffer, which keeps its allocation while the size stays the
+        same; a frame with a header is a view and leaves buffer alone.
+    */
+    if (!valid()) return false;
+
+    m_memory->lock();
+    bool taken = take(frame, buffer);
+    m_memory->unlock();
+    return taken;
+}
+
+bool SharedFrameReader::next(cv::Mat& frame) noexcept
+{
+    return next(frame, m_copy);
+}
+
+bool SharedFrameReader::next(cv::Mat& frame, cv::Mat& buffer) noexcept
+{
+    // A frame published while the previous one was processed is taken at once.
+    if (m_header != nullptr && acquire(frame, buffer)) return true;
+
+    m_memory->wait();
+    return acquire(frame, buffer);
+}
+
+uint64_t SharedFrameReader::sequence() const noexcept
+{
+    return m_sequence;
+}
+
+uint64_t SharedFrameReader::dropped() const noexcept
+{
+    return m_dropped;
+}
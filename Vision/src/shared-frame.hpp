@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2019  Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHARED_FRAME_HPP_INCLUDED
+#define SHARED_FRAME_HPP_INCLUDED
+
+#include "cluon-complete.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+
+#define SHARED_FRAME_MAGIC 0x4657494b // "KIWF"
+#define SHARED_FRAME_VERSION 1
+#define SHARED_FRAME_BUFFERS 3
+#define SHARED_FRAME_MAX_BUFFERS 4
+#define SHARED_FRAME_ALIGNMENT 64
+#define SHARED_FRAME_NONE 0xFFFFFFFF
+
+/*
+    Layout of a shared memory area carrying BGRA frames in several buffers.
+    The header is followed by `buffers` images of `stride`*`height` bytes,
+    the first one `offset` bytes from the start of the area. The geometry
+    is written once by the producer; latest, reading and sequence are only
+    changed with the shared memory locked.
+
+    The producer fills a buffer that is neither `latest` nor `reading` and
+    then publishes it as `latest`. The consumer marks `latest` as `reading`
+    and works on it in place until it takes the next one, so the lock is
+    only held to swap indices.
+
+    A shared memory area without this header holds a single raw BGRA frame
+    that is overwritten in place, as written by the camera decoders; it is
+    copied out under the lock, into a buffer the caller passes or else into
+    one of the reader's own.
+*/
+struct SharedFrameHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t buffers;
+    uint32_t offset;
+    uint32_t latest;
+    uint32_t reading;
+    uint32_t reserved;
+    uint64_t sequence;
+};
+
+uint32_t sharedFrameBytes(uint32_t, uint32_t, uint32_t = SHARED_FRAME_BUFFERS) noexcept;
+
+class SharedFrameWriter
+{
+ public:
+    SharedFrameWriter(cluon::SharedMemory*, uint32_t, uint32_t, uint32_t = SHARED_FRAME_BUFFERS) noexcept;
+    bool valid() const noexcept;
+    cv::Mat acquire() noexcept;
+    void publish() noexcept;
+
+ private:
+    SharedFrameWriter(const SharedFrameWriter &) = delete;
+    SharedFrameWriter &operator=(const SharedFrameWriter &) = delete;
+
+    cluon::SharedMemory* m_memory;
+    SharedFrameHeader* m_header;
+    uint32_t m_writing;
+};
+
+class SharedFrameReader
+{
+ public:
+    SharedFrameReader(cluon::SharedMemory*) noexcept;
+    ~SharedFrameReader() noexcept;
+    bool valid() const noexcept;
+    bool zeroCopy() const noexcept;
+    cv::Size size() const noexcept;
+    bool next(cv::Mat&) noexcept;
+    bool next(cv::Mat&, cv::Mat&) noexcept;
+    bool acquire(cv::Mat&) noexcept;
+    bool acquire(cv::Mat&, cv::Mat&) noexcept;
+    uint64_t sequence() const noexcept;
+    uint64_t dropped() const noexcept;
+
+ private:
+    SharedFrameReader(const SharedFrameReader &) = delete;
+    SharedFrameReader &operator=(const SharedFrameReader &) = delete;
+
+    bool take(cv::Mat&, cv::Mat&) noexcept;
+
+    cluon::SharedMemory* m_memory;
+    SharedFrameHeader* m_header;
+    cv::Size m_size;
+    cv::Mat m_copy;
+    uint64_t m_sequence;
+    uint64_t m_dropped;
+};
+
+#endif // SHARED_FRAME_HPP_INCLUDED
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2019  Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPSC_QUEUE_HPP_INCLUDED
+#define SPSC_QUEUE_HPP_INCLUDED
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+/*
+    Bounded queue between exactly one producer thread and one consumer
+    thread. Neither side ever blocks: push() returns false when the queue
+    holds N items and pop() returns false when it is empty.
+*/
+template <typename T, size_t N>
+class SpscQueue
+{
+ public:
+    SpscQueue() noexcept : m_items(), m_head(0), m_tail(0) {}
+
+    bool push(const T &item) noexcept
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        const size_t next = (tail + 1) % (N + 1);
+        if (next == m_head.load(std::memory_order_acquire)) return false;
+
+        m_items[tail] = item;
+        m_tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item) noexcept
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) return false;
+
+        item = m_items[head];
+        m_head.store((head + 1) % (N + 1), std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const noexcept
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+ private:
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    std::array<T, N + 1> m_items;
+    alignas(64) std::atomic<size_t> m_head;
+    alignas(64) std::atomic<size_t> m_tail;
+};
+
+#endif // SPSC_QUEUE_HPP_INCLUDED
@@ -0,0 +1,490 @@
+/*
+ * Copyright (C) 2019  Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "target-selection.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+/*
+    Where to look for a followed target: its last box moved on by the last
+    motion, grown by half its size, the motion and ROI_MARGIN on every side
+    and clipped to `bounds`.
+*/
+cv::Rect predictRoi(cv::Rect box, cv::Point motion, cv::Rect bounds) noexcept
+{
+    int mx = box.width/2 + std::abs(motion.x) + ROI_MARGIN;
+    int my = box.height/2 + std::abs(motion.y) + ROI_MARGIN;
+    cv::Rect roi(box.x + motion.x - mx, box.y + motion.y - my, box.width + 2*mx, box.height + 2*my);
+    return roi & bounds;
+}
+
+// A box reaching an edge of the region that is not also an edge of the
+// frame may continue outside of it.
+static bool touchesEdge(cv::Rect box, cv::Rect area, cv::Rect bounds) noexcept
+{
+    return (box.x <= area.x && area.x > bounds.x) ||
+           (box.y <= area.y && area.y > bounds.y) ||
+           (box.br().x >= area.br().x && area.br().x < bounds.br().x) ||
+           (box.br().y >= area.br().y && area.br().y < bounds.br().y);
+}
+
+// Compiles the colour of a target with its tolerance.
+static void setRange(HsvRange &range, cv::Scalar hsv)
+{
+    cv::Scalar offset = cv::Scalar(15,25,25);
+    if(hsv[1] <= 30) offset = cv::Scalar(255, 30, 255); //grey
+    if(hsv[2] <= 50 || hsv[2] >= 230) offset = cv::Scalar(255, 255, 40); //black, white
+    range.set(hsv - offset, hsv + offset);
+}
+
+static void segment(Args* p, cv::Rect area, cv::Mat &mask)
+{
+    setRange(p->range, p->hsv_scalar);
+    p->range.apply(p->frame(area), p->in_range);
+    cleanMask(p->in_range, mask);
+}
+
+/*
+    Collects the blobs of `mask` larger than `minimum` pixels into p->blobs,
+    moved by `offset` into frame pixels. One labelling pass gives the area,
+    box and centroid of every blob.
+*/
+void findBlobs(Args* p, const cv::Mat &mask, cv::Point offset, int minimum)
+{
+    int n = cv::connectedComponentsWithStats(mask, p->labels, p->stats, p->centroids, 8, CV_32S);
+    p->blobs.clear();
+    for (int i = 1; i < n; i++) // 0 is the background
+    {
+        const int* s = p->stats.ptr<int>(i);
+        if (s[cv::CC_STAT_AREA] <= minimum) continue;
+        const double* c = p->centroids.ptr<double>(i);
+        p->blobs.push_back(Blob{cv::Rect(s[cv::CC_STAT_LEFT] + offset.x, s[cv::CC_STAT_TOP] + offset.y, s[cv::CC_STAT_WIDTH], s[cv::CC_STAT_HEIGHT]),
+                                s[cv::CC_STAT_AREA], cv::Point2d(c[0] + offset.x, c[1] + offset.y)});
+    }
+}
+
+ZoneMap::ZoneMap(uint16_t width, uint16_t height) noexcept :
+    m_zones(height, width, CV_8UC1)
+{
+    for (int y = 0; y < height; y++)
+    {
+        uchar* zone = m_zones.ptr<uchar>(y);
+        for (int x = 0; x < width; x++)
+        {
+            if (y < T_ABOVE(height)) zone[x] = ZONE_ABOVE;
+            else if (y > T_BELOW(height)) zone[x] = ZONE_BELOW;
+            else if (x < T_LEFT(width)) zone[x] = ZONE_LEFT;
+            else if (x > T_RIGHT(width)) zone[x] = ZONE_RIGHT;
+            else zone[x] = ZONE_TARGET;
+        }
+    }
+}
+
+uint8_t ZoneMap::at(int x, int y) const noexcept
+{
+    x = std::min(std::max(x, 0), m_zones.cols - 1);
+    y = std::min(std::max(y, 0), m_zones.rows - 1);
+    return m_zones.at<uchar>(y, x);
+}
+
+Track::Track() noexcept :
+    m_position(), m_velocity(), m_size(), m_missed(0)
+{
+}
+
+void Track::start(cv::Rect box) noexcept
+{
+    m_position = cv::Point2d(box.x + box.width/2.0, box.y + box.height/2.0);
+    m_velocity = cv::Point2d(0, 0);
+    m_size = cv::Point2d(box.width, box.height);
+    m_missed = 0;
+}
+
+void Track::update(cv::Rect box) noexcept
+{
+    cv::Point2d residual(box.x + box.width/2.0 - (m_position.x + m_velocity.x),
+                         box.y + box.height/2.0 - (m_position.y + m_velocity.y));
+    m_position += m_velocity + TRACK_ALPHA*residual;
+    m_velocity += TRACK_BETA*residual;
+    m_size += TRACK_ALPHA*(cv::Point2d(box.width, box.height) - m_size);
+    m_missed = 0;
+}
+
+// Moves on without a measurement; false once the target has been unseen too long.
+bool Track::coast() noexcept
+{
+    m_position += m_velocity;
+    return ++m_missed <= TRACK_COAST;
+}
+
+// The blob closest to the prediction within the gate, or -1.
+int Track::nearest(const std::vector<Blob> &blobs) const noexcept
+{
+    const cv::Point2d expected = m_position + m_velocity;
+    const double gate = TRACK_GATE*std::max(m_size.x, m_size.y) + std::abs(m_velocity.x) + std::abs(m_velocity.y);
+    double closest = gate*gate;
+    int iLabel = -1;
+    for (int i = 0; i < blobs.size(); i++)
+    {
+        const cv::Point2d d = blobs[i].centroid - expected;
+        if (d.x*d.x + d.y*d.y <= closest)
+        {
+            closest = d.x*d.x + d.y*d.y;
+            iLabel = i;
+        }
+    }
+    return iLabel;
+}
+
+cv::Rect Track::box() const noexcept
+{
+    return cv::Rect(cvRound(m_position.x - m_size.x/2), cvRound(m_position.y - m_size.y/2), cvRound(m_size.x), cvRound(m_size.y));
+}
+
+cv::Rect Track::predicted() const noexcept
+{
+    return box() + velocity();
+}
+
+cv::Point Track::velocity() const noexcept
+{
+    return cv::Point(cvRound(m_velocity.x), cvRound(m_velocity.y));
+}
+
+TargetTable::TargetTable() noexcept :
+    next(1)
+{
+    for (int i = 0; i < TARGET_SLOTS; i++)
+    {
+        id[i] = 0;
+        age[i] = 0;
+    }
+}
+
+// Stores a newly selected target, in place of the oldest one when full.
+int TargetTable::add(cv::Rect t, cv::Scalar hsv, const Track &motion) noexcept
+{
+    int slot = 0;
+    for (int i = 0; i < TARGET_SLOTS; i++)
+    {
+        if (id[i] == 0) { slot = i; break; }
+        if (age[i] > age[slot]) slot = i;
+    }
+    id[slot] = next++;
+    box[slot] = t;
+    colour[slot] = hsv;
+    setRange(range[slot], hsv);
+    track[slot] = motion;
+    age[slot] = 0;
+    return slot;
+}
+
+// The slot of the target under `point`, or -1.
+int TargetTable::at(cv::Point point) const noexcept
+{
+    for (int i = 0; i < TARGET_SLOTS; i++)
+        if (id[i] != 0 && box[i].contains(point)) return i;
+    return -1;
+}
+
+void defaultValues(Args* p)
+{
+    uint16_t WIDTH = p->WIDTH;
+    uint16_t HEIGHT = p->HEIGHT;
+    uint16_t maximum_x = p->WIDTH/2 - T_LEFT(WIDTH);
+    uint16_t maximum_y = p->HEIGHT/2 - T_BELOW(HEIGHT);
+
+    p->angle = p->x/(float)WIDTH;
+    p->action = DIRECTIONAL;
+    if (p->VERBOSE) std::cout << "Angle: " << p->angle << std::endl;
+}
+
+void findObject(Args* p)
+{
+    uint16_t WIDTH = p->WIDTH;
+    uint16_t HEIGHT = p->HEIGHT;
+    uint16_t x = p->x;
+    uint16_t y = p->y;
+
+    /*
+        A new target is searched for in the whole region in front of the
+        vehicle. One being followed is only searched for around where its
+        track expects it; when it is not found there, or may extend past the
+        searched region, the whole region is searched again.
+    */
+    const cv::Rect selection(0, 0, p->WIDTH, T_BELOW(HEIGHT));
+    cv::Rect area = selection;
+    if (p->SELECTION_MODE == FOLLOWING)
+    {
+        area = predictRoi(p->track.box(), p->track.velocity(), selection);
+        if (area.empty()) area = selection;
+    }
+
+    cv::Mat &mask = p->cleaned;
+    int iLabel = -1;
+    while (true)
+    {
+        segment(p, area, mask);
+        if(p->MASKVIEW) // shown by the display stage
+        {
+            p->mask.create(selection.size(), CV_8UC1);
+            p->mask.setTo(cv::Scalar(0));
+            mask.copyTo(p->mask(area));
+        }
+
+        //if the selection is not within a now cleaned mask – discard:
+        if (p->SELECTION_MODE == FIND_NEW && (!selection.contains(cv::Point(x, y)) || mask.at<uchar>(y, x) == 0))
+        {
+            if (p->VERBOSE) std::cout << "No object" << std::endl;
+            p->roi = area;
+            return;
+        }
+
+        findBlobs(p, mask, area.tl(), WIDTH*2);
+        if (p->SELECTION_MODE != FOLLOWING) break;
+
+        iLabel = p->track.nearest(p->blobs);
+        if (area == selection || (iLabel >= 0 && !touchesEdge(p->blobs[iLabel].box, area, selection))) break;
+        if (p->VERBOSE) std::cout << "Target outside of the predicted region" << std::endl;
+        area = selection;
+    }
+    p->roi = area;
+
+    if (p->SELECTION_MODE == FOLLOWING) //already following...
+    {
+        if (iLabel >= 0)
+        {
+            p->t = p->blobs[iLabel].box;
+            p->track.update(p->t);
+            if(p->VERBOSE) std::cout << "new rectangle: " << p->t.tl() << std::endl;
+        }
+        else if (p->track.coast())
+        {
+            p->t = p->track.box();
+            if(p->VERBOSE) std::cout << "Target not seen, expected at " << p->t.tl() << std::endl;
+        }
+        else
+        {
+            if(p->VERBOSE) std::cout << "Lost the target" << std::endl;
+            p->SELECTION_MODE = FIND_NEW;
+            return;
+        }
+    }
+    else if (p->blobs.empty())
+    {
+        if(p->VERBOSE) std::cout << "No object" << std::endl;
+        return;
+    }
+    else
+    {
+        double closest = -1;
+        for (const Blob &b : p->blobs)
+        {
+            //check how close to the selection
+            double dx = p->x - b.centroid.x;
+            double dy = p->y - b.centroid.y;
+            double selection_distance = dx*dx + dy*dy;
+            if(closest < 0 || selection_distance < closest)
+            {
+                closest = selection_distance;
+                p->t = b.box;
+            }
+        }
+        p->track.start(p->t);
+    }
+
+    if(p->t.height > HEIGHT*ARRIVED) //close enough
+    {
+        if(p->SELECTION_MODE == FOLLOWING)
+        {
+          if(p->VERBOSE) std::cout << "Arrived!" << std::endl;
+          p->action = STATIONARY;
+        }
+        else
+        {
+          if(p->VERBOSE) std::cout << "Reversing" << std::endl;
+          p->action = MOVE_BACKWARDS;
+        }
+        p->SELECTION_MODE = FIND_NEW;
+        return;
+    }
+    else if(p->t.width > WIDTH*0.8) //the area covers most of the field view in width: not an object
+    {
+        if(p->VERBOSE) std::cout << "Not an object. Background?" << std::endl;
+        p->SELECTION_MODE = FIND_NEW;
+        return;
+    }
+
+    //distance = -1;
+    p->SELECTION_MODE = FOLLOWING;
+
+    // steering follows the filtered position rather than every measurement
+    const cv::Rect steer = p->track.box();
+    float position = steer.tl().x + steer.width*0.5f;
+    p->angle = position/(float)WIDTH;
+    p->action = DIRECTIONAL;
+
+    if(p->VERBOSE) std::cout << "The target was found at angle " << p->angle << std::endl;
+}
+
+bool isGround(cv::Scalar hsv) //test values
+{
+    cv::Scalar hsv_min = cv::Scalar(10, 35, 10);
+    cv::Scalar hsv_max = cv::Scalar(20, 150, 230);
+
+    return isWithin(hsv, hsv_min, hsv_max);
+}
+
+void findAction(Args* p)
+{
+    if(!(p->active)) return;
+
+    if((p->fixation || p->potential))
+    {
+      uint16_t x = p->x;
+      uint16_t y = p->y;
+      uint16_t WIDTH = p->WIDTH;
+      uint16_t HEIGHT = p->HEIGHT;
+      bool MODE = p->MODE;
+      p->SELECTION_MODE = FIND_NEW;
+
+      switch (p->zones.at(x, y))
+      {
+        case ZONE_ABOVE:
+          p->action = MOVE_BACKWARDS;
+          p->angle = 0;
+          if(p->VERBOSE) std::cout << "Back" << std::endl;
+          if(p->VISUALIZE) cv::rectangle(p->frame, cv::Point(0, 0),
+          cv::Point(WIDTH, T_ABOVE(HEIGHT)), cv::Scalar(255,255,255), -1);
+          return;
+        case ZONE_BELOW:
+          p->action = MOVE_BACKWARDS;
+          p->angle = 0;
+          if(p->VERBOSE) std::cout << "Back" << std::endl;
+          if(p->VISUALIZE) cv::rectangle(p->frame, cv::Point(0, T_BELOW(HEIGHT)),
+          cv::Point(WIDTH, HEIGHT), cv::Scalar(255,255,255), -1);
+          return;
+        case ZONE_LEFT:
+          p->action = LEFT_TURN;
+          if(p->VERBOSE) std::cout << "Left" << std::endl;
+          if(p->VISUALIZE) cv::rectangle(p->frame, cv::Point(0, 0),
+          cv::Point(T_LEFT(WIDTH), HEIGHT), cv::Scalar(255,255,255), -1);
+          return;
+        case ZONE_RIGHT:
+          p->action = RIGHT_TURN;
+          if(p->VERBOSE) std::cout << "Right" << std::endl;
+          if(p->VISUALIZE) cv::rectangle(p->frame, cv::Point(T_RIGHT(WIDTH), 0),
+          cv::Point(WIDTH, HEIGHT), cv::Scalar(255,255,255), -1);
+          return;
+      }
+
+      if (MODE == MODE_SIMPLE) //provide angle if the directional mode was selected
+      {
+          defaultValues(p);
+          return;
+      }
+      if (MODE == MODE_TARGET) { //find object
+        int slot = p->targets.at(cv::Point(x, y));
+        if (slot >= 0) // already tracked: take it over instead of segmenting anew
+        {
+            if (p->VERBOSE) std::cout << "Selected target " << p->targets.id[slot] << std::endl;
+            p->selected = slot;
+            p->t = p->targets.box[slot];
+            p->track = p->targets.track[slot];
+            p->hsv_scalar = p->targets.colour[slot];
+            p->SELECTION_MODE = FOLLOWING;
+            findObject(p);
+            return;
+        }
+
+        cv::Rect selection(x-4, y-4, 8, 8); //pixel is guaranteed to be away from the border
+        cv::Scalar meanvalue = meanHsv(p->frame, selection); //mean of the gaze area, converting only its pixels
+
+        uint16_t h = static_cast<uint16_t>(meanvalue[0]);
+        uint16_t s = static_cast<uint16_t>(meanvalue[1]);
+        uint16_t v = static_cast<uint16_t>(meanvalue[2]);
+
+        p->hsv_scalar = cv::Scalar(h,s,v);
+
+        if(isGround(p->hsv_scalar))
+        {
+            if (p->VERBOSE) std::cout << "Selected the ground or wall." << std::endl; //color to be always ignored, discarded
+            return;
+        }
+        findObject(p);
+        if (p->SELECTION_MODE == FOLLOWING)
+        {
+            p->selected = p->targets.add(p->t, p->hsv_scalar, p->track);
+            if (p->VERBOSE) std::cout << "New target " << p->targets.id[p->selected] << std::endl;
+        }
+      }
+    }
+    else if (p->SELECTION_MODE == FOLLOWING) { //continue following object
+        findObject(p);
+    }
+}
+
+/*
+    Moves every target in the table on by one frame. The followed one is
+    copied from findObject; the others are searched for only around their
+    predictions, each with its own colour, and dropped once lost.
+*/
+void updateTargets(Args* p)
+{
+    TargetTable &targets = p->targets;
+    const cv::Rect selection(0, 0, p->WIDTH, T_BELOW(p->HEIGHT));
+
+    for (int i = 0; i < TARGET_SLOTS; i++)
+    {
+        if (targets.id[i] == 0) continue;
+        targets.age[i]++;
+
+        if (i == p->selected)
+        {
+            if (p->SELECTION_MODE == FOLLOWING)
+            {
+                targets.box[i] = p->t;
+                targets.track[i] = p->track;
+                continue;
+            }
+            p->selected = -1; // no longer followed; tracked like the others from the next frame
+            continue;
+        }
+
+        Track &track = targets.track[i];
+        cv::Rect area = predictRoi(track.box(), track.velocity(), selection);
+        int iLabel = -1;
+        if (!area.empty())
+        {
+            targets.range[i].apply(p->frame(area), p->in_range);
+            cleanMask(p->in_range, p->cleaned);
+            findBlobs(p, p->cleaned, area.tl(), p->WIDTH*2);
+            iLabel = track.nearest(p->blobs);
+        }
+
+        if (iLabel >= 0)
+        {
+            targets.box[i] = p->blobs[iLabel].box;
+            track.update(targets.box[i]);
+        }
+        else if (track.coast()) targets.box[i] = track.box();
+        else targets.id[i] = 0;
+    }
+}
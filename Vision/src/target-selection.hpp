@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2019  Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TARGET_SELECTION_HPP_INCLUDED
+#define TARGET_SELECTION_HPP_INCLUDED
+
+#include "kiwi-image-processing.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#define HORIZON(a) static_cast<uint16_t>(a/2-10)
+
+#define ARRIVED 0.65
+
+#define T_BELOW(a) (int)(a * 0.7)
+#define T_ABOVE(a) (int)(a * 0.12)
+#define T_LEFT(a) (int)(a * 0.10)
+#define T_RIGHT(a) a - T_LEFT(a)
+
+#define FOLLOWING 1
+#define FIND_NEW 0
+
+#define MODE_TARGET 1
+#define MODE_SIMPLE 0
+
+#define STATIONARY 0
+#define RIGHT_TURN 1
+#define LEFT_TURN 2
+#define MOVE_BACKWARDS 10
+
+#define DIRECTIONAL 13
+
+#define ZONE_TARGET 0 // gaze zones of the frame, see ZoneMap
+#define ZONE_ABOVE 1
+#define ZONE_BELOW 2
+#define ZONE_LEFT 3
+#define ZONE_RIGHT 4
+
+#define ROI_MARGIN 16 // pixels around the predicted box searched while following
+
+#define TRACK_ALPHA 0.5 // weight of a measured position against the prediction
+#define TRACK_BETA 0.2  // weight of the residual in the velocity
+#define TRACK_GATE 1.0  // accepted distance from the prediction, in target sizes
+#define TRACK_COAST 5   // frames a target may go unseen before it is lost
+
+#define TARGET_SLOTS 8  // targets tracked at once, the followed one included
+
+/*
+    The zone under every pixel of the frame, laid out once from the
+    T_ABOVE, T_BELOW, T_LEFT and T_RIGHT bands so that findAction looks the
+    gaze up instead of comparing it with each band in turn. Points past the
+    frame take the zone of the nearest edge.
+*/
+class ZoneMap
+{
+ public:
+    ZoneMap(uint16_t, uint16_t) noexcept;
+    uint8_t at(int, int) const noexcept;
+
+ private:
+    cv::Mat m_zones;  // CV_8UC1, one zone per pixel
+};
+
+/* A connected region of the target mask, in frame pixels. */
+struct Blob
+{
+    cv::Rect box;
+    int area;
+    cv::Point2d centroid;
+};
+
+/*
+    Alpha-beta filter over the centre and size of a followed target, one
+    step per frame. It predicts where the target will be, accepts only
+    blobs near that prediction and carries the target over a few frames
+    in which it is not seen.
+*/
+class Track
+{
+ public:
+    Track() noexcept;
+    void start(cv::Rect) noexcept;
+    void update(cv::Rect) noexcept;
+    bool coast() noexcept;
+    int nearest(const std::vector<Blob>&) const noexcept;
+    cv::Rect box() const noexcept;
+    cv::Rect predicted() const noexcept;
+    cv::Point velocity() const noexcept;
+
+ private:
+    cv::Point2d m_position;
+    cv::Point2d m_velocity;
+    cv::Point2d m_size;
+    int m_missed;
+};
+
+/*
+    Targets selected earlier and still tracked in the background, so that
+    a glance back at one of them selects it without segmenting the frame
+    again. Kept field by field; a slot is free while its id is 0.
+*/
+struct TargetTable
+{
+    int id[TARGET_SLOTS];
+    cv::Rect box[TARGET_SLOTS];
+    cv::Scalar colour[TARGET_SLOTS];
+    HsvRange range[TARGET_SLOTS];
+    Track track[TARGET_SLOTS];
+    int age[TARGET_SLOTS];   // frames since the target was selected
+    int next;
+
+    TargetTable() noexcept;
+    int add(cv::Rect, cv::Scalar, const Track&) noexcept;
+    int at(cv::Point) const noexcept;
+};
+
+struct Args
+{
+    uint16_t x;
+    uint16_t y;
+    const uint16_t WIDTH;
+    const uint16_t HEIGHT;
+    uint16_t action;
+    cv::Mat frame;
+    cv::Mat mask;
+    cv::Mat in_range;  // segmented and cleaned masks of the searched region
+    cv::Mat cleaned;
+    cv::Scalar hsv_scalar;
+    HsvRange range;    // hsv_scalar with its tolerance, compiled for segmenting
+    cv::Rect t;
+    cv::Rect roi;      // region segmented for the last frame
+    Track track;       // motion of the followed target
+    TargetTable targets;
+    int selected;      // slot of the followed target in targets, or -1
+    std::vector<Blob> blobs; // candidates found in the last frame
+    cv::Mat labels;
+    cv::Mat stats;
+    cv::Mat centroids;
+    const ZoneMap zones;
+    bool fixation;
+    bool active;
+    bool potential;
+    bool MODE;
+    bool SELECTION_MODE;
+    const bool VERBOSE;
+    const bool VISUALIZE;
+    const bool MASKVIEW;
+    float angle;
+
+    Args(bool T_MODE, bool T_VERBOSE, bool T_VISUALIZE, bool T_MASKVIEW, uint16_t width, uint16_t height) :
+            WIDTH(width), HEIGHT(height), MODE(T_MODE), x(0), y(0), fixation(0), active(0), action(0),
+            SELECTION_MODE(FIND_NEW), selected(-1), zones(width, height), potential(0), angle(0), MASKVIEW(T_MASKVIEW), VERBOSE(T_VERBOSE), VISUALIZE(T_VISUALIZE) {}
+};
+
+cv::Rect predictRoi(cv::Rect, cv::Point, cv::Rect) noexcept;
+void findBlobs(Args*, const cv::Mat&, cv::Point, int);
+void defaultValues(Args*);
+void findObject(Args*);
+bool isGround(cv::Scalar);
+void findAction(Args*);
+void updateTargets(Args*);
+
+#endif // TARGET_SELECTION_HPP_INCLUDED
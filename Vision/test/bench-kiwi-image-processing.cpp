@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2019  Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cluon-complete.hpp"
+#include "kiwi-image-processing.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/* Timings of one benchmark, in microseconds per frame. */
+struct BenchResult
+{
+    std::string name;
+    int width;
+    int height;
+    size_t iterations;
+    double min_us;
+    double median_us;
+    double p99_us;
+};
+
+/* Per-pixel kernel as used before the LUT version, kept as a baseline. */
+static void reference_normalize(cv::Mat mat, cv::Scalar difference, float strength)
+{
+    const int cn = mat.channels();
+    for (int y = 0; y < mat.rows; ++y) {
+        uchar* ptr = mat.ptr<uchar>(y);
+        for (int x = 0; x < mat.cols; ++x, ptr += cn) {
+            for (int c = 0; c < 3; ++c) {
+                int v = ptr[c];
+                float scale = 1 - (abs(v - 127)/127.0f);
+                v -= static_cast<int>(static_cast<int>(difference(c))*scale*strength);
+                ptr[c] = static_cast<uchar>(std::min(255, std::max(0, v)));
+            }
+        }
+    }
+}
+
+/* cleanMask as it was: threshold, then a new element, erode and dilate. */
+static cv::Mat reference_clean_mask(cv::Mat input)
+{
+    cv::Mat mask, out;
+    cv::threshold(input, mask, 220.0, 255.0, cv::THRESH_BINARY);
+
+    int erosion_size = 4;
+    cv::Mat element = cv::getStructuringElement(cv::MORPH_RECT,
+    cv::Size(2 * erosion_size + 1, 2 * erosion_size + 1),
+    cv::Point(erosion_size, erosion_size));
+
+    cv::erode(mask, out, element);
+    cv::dilate(out, out, element);
+    return out;
+}
+
+static cv::Mat test_frame(int width, int height)
+{
+    // Deterministic gradient with some texture; values span the full range.
+    cv::Mat frame(height, width, CV_8UC4);
+    for (int y = 0; y < height; ++y) {
+        uchar* ptr = frame.ptr<uchar>(y);
+        for (int x = 0; x < width; ++x, ptr += 4) {
+            ptr[0] = static_cast<uchar>((x*255)/width);
+            ptr[1] = static_cast<uchar>((y*255)/height);
+            ptr[2] = static_cast<uchar>((x*7 + y*13) & 0xFF);
+            ptr[3] = 255;
+        }
+    }
+    return frame;
+}
+
+/* Blocky binary mask with some specks, as segmentation leaves it. */
+static cv::Mat test_mask(int width, int height)
+{
+    cv::Mat mask(height, width, CV_8UC1, cv::Scalar(0));
+    for (int y = 0; y < height; ++y) {
+        uchar* ptr = mask.ptr<uchar>(y);
+        for (int x = 0; x < width; ++x)
+            ptr[x] = (((x/24 + y/16) % 3 == 0) || ((x*31 + y*17) % 97 == 0)) ? 255 : 0;
+    }
+    return mask;
+}
+
+static BenchResult measure(const std::string &name, const cv::Mat &source, size_t iterations, const std::function<void(cv::Mat)> &f)
+{
+    const int width = source.cols;
+    const int height = source.rows;
+    cv::Mat frame;
+    std::vector<double> samples(iterations);
+
+    for (size_t i = 0; i < iterations/10 + 1; i++) { // warm-up
+        source.copyTo(frame);
+        f(frame);
+    }
+
+    for (size_t i = 0; i < iterations; i++) {
+        source.copyTo(frame);
+        auto start = std::chrono::steady_clock::now();
+        f(frame);
+        auto end = std::chrono::steady_clock::now();
+        samples[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()/1e3;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    return BenchResult{name, width, height, iterations, samples.front(), samples[iterations/2],
+                       samples[std::min(iterations - 1, iterations*99/100)]};
+}
+
+static BenchResult measure(const std::string &name, int width, int height, size_t iterations, const std::function<void(cv::Mat)> &f)
+{
+    return measure(name, test_frame(width, height), iterations, f);
+}
+
+int32_t main(int32_t argc, char **argv) {
+    auto commandlineArguments = cluon::getCommandlineArguments(argc, argv);
+    const std::string JSON{(commandlineArguments.count("json") != 0) ? commandlineArguments["json"] : "vision-bench.json"};
+    const std::string LABEL{(commandlineArguments.count("label") != 0) ? commandlineArguments["label"] : ""};
+    const size_t ITERATIONS{(commandlineArguments.count("iterations") != 0) ? static_cast<size_t>(std::stoi(commandlineArguments["iterations"])) : 100};
+
+    const cv::Size SIZES[] = {cv::Size(640, 480), cv::Size(1344, 1008)};
+    const cv::Scalar DIFFERENCE(12, -8, 20);
+    const float STRENGTH = 0.9f;
+
+    // Masks cleaned per frame: a predicted region, the camera frame below
+    // the horizon and the same at the old display resolution.
+    const cv::Size MASK_SIZES[] = {cv::Size(160, 160), cv::Size(640, 336), cv::Size(1344, 705)};
+
+    std::vector<BenchResult> results;
+    for (const cv::Size &size : MASK_SIZES) {
+        const cv::Mat mask = test_mask(size.width, size.height);
+        results.push_back(measure("cleanMask-reference", mask, ITERATIONS, [](cv::Mat m){
+            reference_clean_mask(m);
+        }));
+        cv::Mat cleaned;
+        results.push_back(measure("cleanMask", mask, ITERATIONS, [&](cv::Mat m){
+            cleanMask(m, cleaned);
+        }));
+    }
+    for (const cv::Size &size : SIZES) {
+        results.push_back(measure("normalize-reference", size.width, size.height, ITERATIONS, [&](cv::Mat frame){
+            reference_normalize(frame, DIFFERENCE, STRENGTH);
+        }));
+        results.push_back(measure("normalize-lut", size.width, size.height, ITERATIONS, [&](cv::Mat frame){
+            cv::LUT(frame, normalization_lut(DIFFERENCE, STRENGTH, frame.channels()), frame);
+        }));
+        results.push_back(measure("increase_brightness", size.width, size.height, ITERATIONS, [](cv::Mat frame){
+            increase_brightness(frame);
+        }));
+        results.push_back(measure("balance_white-full-histogram", size.width, size.height, ITERATIONS, [](cv::Mat frame){
+            cv::LUT(frame, white_balance_lut(frame, 1), frame);
+        }));
+        results.push_back(measure("balance_white", size.width, size.height, ITERATIONS, [](cv::Mat frame){
+            balance_white(frame);
+        }));
+        results.push_back(measure("normalize_t", size.width, size.height, ITERATIONS, [](cv::Mat frame){
+            normalize_t(frame, frame);
+        }));
+        results.push_back(measure("normalization_frame_lut", size.width, size.height, ITERATIONS, [](cv::Mat frame){
+            cv::LUT(frame, normalization_frame_lut(frame), frame);
+        }));
+        cv::Mat hsv, mask;
+        const cv::Scalar LOW(100, 150, 150), HIGH(130, 200, 200);
+        results.push_back(measure("cvtColor-hsv-inRange", size.width, size.height, ITERATIONS, [&](cv::Mat frame){
+            cv::cvtColor(frame, hsv, cv::COLOR_BGRA2BGR);
+            cv::cvtColor(hsv, hsv, cv::COLOR_BGR2HSV);
+            cv::inRange(hsv, LOW, HIGH, mask);
+        }));
+        HsvRange range;
+        range.set(LOW, HIGH);
+        results.push_back(measure("HsvRange", size.width, size.height, ITERATIONS, [&](cv::Mat frame){
+            range.apply(frame, mask);
+        }));
+        // findAction's mean of the gaze area
+        const cv::Rect GAZE(size.width/2, size.height/2, 8, 8);
+        cv::Scalar gaze;
+        results.push_back(measure("gaze-cvtColor-mean", size.width, size.height, ITERATIONS, [&](cv::Mat frame){
+            cv::Mat cutout = frame(GAZE);
+            cv::cvtColor(cutout, cutout, cv::COLOR_BGRA2BGR);
+            cv::cvtColor(cutout, cutout, cv::COLOR_BGR2HSV);
+            gaze = cv::mean(cutout);
+        }));
+        results.push_back(measure("gaze-meanHsv", size.width, size.height, ITERATIONS, [&](cv::Mat frame){
+            gaze = meanHsv(frame, GAZE);
+        }));
+        Normalizer normalizer;
+        results.push_back(measure("Normalizer-cached", size.width, size.height, ITERATIONS, [&](cv::Mat frame){
+            normalizer.apply(frame);
+        }));
+    }
+
+    for (const BenchResult &r : results) {
+        std::cout << r.name << " " << r.width << "x" << r.height
+                  << ": median " << r.median_us << " us, p99 " << r.p99_us << " us" << std::endl;
+    }
+
+    std::ofstream out(JSON);
+    out << "{\n  \"label\": \"" << LABEL << "\",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult &r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"width\": " << r.width << ", \"height\": " << r.height
+            << ", \"iterations\": " << r.iterations << ", \"min_us\": " << r.min_us << ", \"median_us\": " << r.median_us
+            << ", \"p99_us\": " << r.p99_us << "}" << ((i + 1 < results.size()) ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    std::cout << "Results written to " << JSON << std::endl;
+    return 0;
+}
@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2019  Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+    Runs the processing stage of opendlv-vision-bci headlessly over recorded
+    frames and a gaze trace, without a camera, an eye tracker or OD4:
+
+      ./opendlv-vision-bci-bench-pipeline --frames=<directory or video> [--gaze=<trace.csv>]
+          [--count=<frames>] [--mode=<0|1>] [--normalize] [--json=<file>] [--label=<commit>]
+
+    Without --frames a synthetic scene of two moving blocks is used, and
+    without --gaze a trace that selects each block in turn and glances at
+    the left band. A trace has one line per frame, "x,y,fixation[,potential]",
+    with x and y from 0 to 1 across the frame as the Pupil gaze gives them;
+    it is repeated when it is shorter than the frames.
+*/
+
+#include "cluon-complete.hpp"
+#include "action-output.hpp"
+#include "counting-allocator.hpp"
+#include "kiwi-image-processing.hpp"
+#include "recorded-frames.hpp"
+#include "target-selection.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define SYNTHETIC_FRAMES 600
+#define SYNTHETIC_CYCLE 120 // frames between two selections of the same block
+
+/* One sample of the gaze trace, in fractions of the frame. */
+struct GazeSample
+{
+    float x;
+    float y;
+    bool fixation;
+    bool potential;
+};
+
+/* Timings of one stage, in microseconds per frame. */
+struct StageResult
+{
+    std::string name;
+    double min_us;
+    double median_us;
+    double p99_us;
+    double mean_us;
+};
+
+static StageResult summarize(const std::string &name, std::vector<double> samples)
+{
+    if (samples.empty()) return StageResult{name, 0, 0, 0, 0};
+    double total{0};
+    for (double s : samples) total += s;
+    std::sort(samples.begin(), samples.end());
+    const size_t n = samples.size();
+    return StageResult{name, samples.front(), samples[n/2], samples[std::min(n - 1, n*99/100)], total/n};
+}
+
+static double microseconds(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()/1e3;
+}
+
+// Grey floor with a blue and a green block moving across it.
+static std::vector<cv::Mat> syntheticFrames(int width, int height, size_t count, std::vector<cv::Point> &centres)
+{
+    std::vector<cv::Mat> frames;
+    const int side = std::max(8, width/12);
+    const int top = T_BELOW(height)/2 - side/2;
+    for (size_t i = 0; i < count; i++)
+    {
+        cv::Mat frame(height, width, CV_8UC4, cv::Scalar(90, 90, 90, 255));
+        const int swing = width/6;
+        const int step = static_cast<int>(i % (4*swing));
+        const int offset = (step < 2*swing) ? step - swing : 3*swing - step;
+        cv::Rect a(width/3 - side/2 + offset, top, side, side);
+        cv::Rect b(2*width/3 - side/2 - offset, top + side/2, side, side);
+        frame(a).setTo(cv::Scalar(200, 60, 30, 255));
+        frame(b).setTo(cv::Scalar(40, 180, 60, 255));
+        centres.push_back(cv::Point(a.x + side/2, a.y + side/2));
+        centres.push_back(cv::Point(b.x + side/2, b.y + side/2));
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+static std::vector<GazeSample> loadGaze(const std::string &path)
+{
+    std::vector<GazeSample> trace;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.empty() || line[0] == '#') continue;
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream fields(line);
+        GazeSample sample{0, 0, false, false};
+        int fixation{0}, potential{0};
+        if (!(fields >> sample.x >> sample.y >> fixation)) continue;
+        fields >> potential;
+        sample.fixation = fixation != 0;
+        sample.potential = potential != 0;
+        trace.push_back(sample);
+    }
+    return trace;
+}
+
+// Selects the blue block, then the green one, then looks at the left band.
+static std::vector<GazeSample> syntheticGaze(const std::vector<cv::Point> &centres, cv::Size size)
+{
+    std::vector<GazeSample> trace;
+    for (size_t i = 0; i < centres.size()/2; i++)
+    {
+        const size_t phase = i % SYNTHETIC_CYCLE;
+        cv::Point at = centres[2*i + ((phase < SYNTHETIC_CYCLE/2) ? 0 : 1)];
+        GazeSample sample{static_cast<float>(at.x)/size.width, static_cast<float>(at.y)/size.height,
+                          phase == 0 || phase == SYNTHETIC_CYCLE/2, false};
+        if (phase == 5*SYNTHETIC_CYCLE/6) sample = GazeSample{0.05f, 0.5f, true, false};
+        trace.push_back(sample);
+    }
+    return trace;
+}
+
+int32_t main(int32_t argc, char **argv) {
+    auto commandlineArguments = cluon::getCommandlineArguments(argc, argv);
+    const std::string FRAMES{(commandlineArguments.count("frames") != 0) ? commandlineArguments["frames"] : ""};
+    const std::string GAZE{(commandlineArguments.count("gaze") != 0) ? commandlineArguments["gaze"] : ""};
+    const std::string JSON{(commandlineArguments.count("json") != 0) ? commandlineArguments["json"] : "vision-pipeline-bench.json"};
+    const std::string LABEL{(commandlineArguments.count("label") != 0) ? commandlineArguments["label"] : ""};
+    const size_t COUNT{(commandlineArguments.count("count") != 0) ? static_cast<size_t>(std::stoi(commandlineArguments["count"])) : SYNTHETIC_FRAMES};
+    const int WIDTH{(commandlineArguments.count("width") != 0) ? std::stoi(commandlineArguments["width"]) : 640};
+    const int HEIGHT{(commandlineArguments.count("height") != 0) ? std::stoi(commandlineArguments["height"]) : 480};
+    const bool MODE{static_cast<bool>((commandlineArguments.count("mode") != 0) ? std::stoi(commandlineArguments["mode"]) : MODE_TARGET)};
+    const bool NORMALIZE{commandlineArguments.count("normalize") != 0};
+
+    std::vector<cv::Point> centres;
+    std::vector<cv::Mat> frames = FRAMES.empty() ? syntheticFrames(WIDTH, HEIGHT, COUNT, centres) : loadFrames(FRAMES, COUNT);
+    if (frames.empty())
+    {
+        std::cerr << argv[0] << ": no frames could be read from '" << FRAMES << "'." << std::endl;
+        return 1;
+    }
+    const cv::Size CAMERA{frames.front().size()};
+    std::vector<GazeSample> gaze = GAZE.empty() ? syntheticGaze(centres, CAMERA) : loadGaze(GAZE);
+    if (gaze.empty()) // select whatever is in the middle once per cycle
+    {
+        if (!GAZE.empty()) std::cout << "Caution: no gaze samples in '" << GAZE << "'; gazing at the centre." << std::endl;
+        for (int i = 0; i < SYNTHETIC_CYCLE; i++) gaze.push_back(GazeSample{0.5f, 0.4f, i == 0, false});
+    }
+    std::clog << argv[0] << ": " << frames.size() << " frames of " << CAMERA.width << "x" << CAMERA.height
+              << ", " << gaze.size() << " gaze samples." << std::endl;
+
+    // the processing stage of opendlv-vision-bci, frame by frame
+    Args param(MODE, false, false, false, static_cast<uint16_t>(CAMERA.width), static_cast<uint16_t>(CAMERA.height));
+    Normalizer normalizer;
+    ActionOutput output;
+    cv::Mat img;
+    std::vector<double> capture, normalize, action, targets, total;
+    size_t followed{0};
+
+    auto run = [&](size_t i, bool timed) {
+        const GazeSample &g = gaze[i % gaze.size()];
+        const auto t0 = std::chrono::steady_clock::now();
+        frames[i].copyTo(img); // as the capture stage fills its slot
+        const auto t1 = std::chrono::steady_clock::now();
+        if (NORMALIZE) normalizer.apply(img);
+        const auto t2 = std::chrono::steady_clock::now();
+        param.x = static_cast<uint16_t>(std::min(std::max(g.x, 0.0f), 1.0f)*CAMERA.width);
+        param.y = static_cast<uint16_t>(std::min(std::max(g.y, 0.0f), 1.0f)*CAMERA.height);
+        param.active = true;
+        param.fixation = g.fixation;
+        param.potential = g.potential;
+        param.frame = img;
+        findAction(&param);
+        const auto t3 = std::chrono::steady_clock::now();
+        updateTargets(&param);
+        output.offer(param.action, param.angle, t3);
+        const auto t4 = std::chrono::steady_clock::now();
+        if (!timed) return;
+        capture.push_back(microseconds(t0, t1));
+        normalize.push_back(microseconds(t1, t2));
+        action.push_back(microseconds(t2, t3));
+        targets.push_back(microseconds(t3, t4));
+        total.push_back(microseconds(t0, t4));
+        if (param.SELECTION_MODE == FOLLOWING) followed++;
+    };
+
+    // one pass to size every buffer, then the measured pass from a fresh state
+    for (size_t i = 0; i < frames.size(); i++) run(i, false);
+    param.SELECTION_MODE = FIND_NEW;
+    param.selected = -1;
+    param.targets = TargetTable();
+    output = ActionOutput();
+
+    size_t allocations;
+    const auto start = std::chrono::steady_clock::now();
+    {
+        CountingAllocator counter;
+        for (size_t i = 0; i < frames.size(); i++) run(i, true);
+        allocations = counter.allocations;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const double fps = frames.size()/seconds;
+
+    std::vector<StageResult> stages;
+    stages.push_back(summarize("capture-copy", capture));
+    if (NORMALIZE) stages.push_back(summarize("normalize", normalize));
+    stages.push_back(summarize("findAction", action));
+    stages.push_back(summarize("updateTargets", targets));
+    stages.push_back(summarize("total", total));
+
+    for (const StageResult &s : stages)
+        std::cout << s.name << ": median " << s.median_us << " us, p99 " << s.p99_us << " us, mean " << s.mean_us << " us" << std::endl;
+    std::cout << frames.size() << " frames in " << seconds << " s: " << fps << " frames/s, "
+              << static_cast<double>(allocations)/frames.size() << " cv::Mat allocations per frame, "
+              << followed << " frames following a target, " << output.messages() << " actions sent" << std::endl;
+
+    std::ofstream out(JSON);
+    out << "{\n  \"label\": \"" << LABEL << "\",\n  \"frames\": " << frames.size() << ", \"width\": " << CAMERA.width
+        << ", \"height\": " << CAMERA.height << ", \"normalize\": " << (NORMALIZE ? "true" : "false")
+        << ",\n  \"fps\": " << fps << ", \"allocations\": " << allocations << ", \"following\": " << followed
+        << ", \"actions\": " << output.messages() << ",\n  \"stages\": [\n";
+    for (size_t i = 0; i < stages.size(); i++) {
+        const StageResult &s = stages[i];
+        out << "    {\"name\": \"" << s.name << "\", \"min_us\": " << s.min_us << ", \"median_us\": " << s.median_us
+            << ", \"p99_us\": " << s.p99_us << ", \"mean_us\": " << s.mean_us << "}" << ((i + 1 < stages.size()) ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    std::cout << "Results written to " << JSON << std::endl;
+    return 0;
+}
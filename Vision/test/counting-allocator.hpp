@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2019  Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COUNTING_ALLOCATOR_HPP_INCLUDED
+#define COUNTING_ALLOCATOR_HPP_INCLUDED
+
+#include <opencv2/core.hpp>
+
+#include <cstddef>
+
+#if CV_VERSION_MAJOR >= 4
+typedef cv::AccessFlag AccessFlags;
+#else
+typedef int AccessFlags;
+#endif
+
+/* Counts the buffers cv::Mat allocates while it is the default allocator. */
+class CountingAllocator : public cv::MatAllocator
+{
+ public:
+    CountingAllocator() : allocations(0), m_std(cv::Mat::getStdAllocator()), m_previous(cv::Mat::getDefaultAllocator())
+    {
+        cv::Mat::setDefaultAllocator(this);
+    }
+
+    ~CountingAllocator()
+    {
+        cv::Mat::setDefaultAllocator(m_previous);
+    }
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, AccessFlags flags, cv::UMatUsageFlags usageFlags) const override
+    {
+        if (data == nullptr) allocations++;
+        return m_std->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+
+    bool allocate(cv::UMatData* data, AccessFlags flags, cv::UMatUsageFlags usageFlags) const override
+    {
+        return m_std->allocate(data, flags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData* data) const override
+    {
+        m_std->deallocate(data);
+    }
+
+    mutable size_t allocations;
+
+ private:
+    CountingAllocator(const CountingAllocator &) = delete;
+    CountingAllocator &operator=(const CountingAllocator &) = delete;
+
+    cv::MatAllocator* m_std;
+    cv::MatAllocator* m_previous;
+};
+
+#endif // COUNTING_ALLOCATOR_HPP_INCLUDED
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2019  Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+    Stands in for the camera microservice: publishes frames into the named
+    shared memory area that opendlv-vision-bci attaches to, at a fixed rate,
+    so that the service can be run and loaded without a camera:
+
+      ./opendlv-vision-bci-producer --name=<shared memory> [--width=<w>] [--height=<h>] [--fps=<rate>]
+          [--frames=<directory or video>] [--count=<frames>] [--raw] [--verbose]
+
+    Frames go through SharedFrameWriter, or with --raw are written in place
+    as one BGRA frame under the lock, as the camera decoders do; either way
+    readers are woken with notifyAll. Without --frames a synthetic scene of
+    a moving block is repeated.
+*/
+
+#include "cluon-complete.hpp"
+#include "recorded-frames.hpp"
+#include "shared-frame.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define PRODUCER_FPS 30
+#define PRODUCER_FRAMES 600   // frames loaded from --frames at most
+#define SYNTHETIC_LOOP 120    // frames in the synthetic scene before it repeats
+#define REPORT_PERIOD_S 1
+
+static std::atomic<bool> running{true};
+
+static void onStop(int) {
+    running = false;
+}
+
+// Grey floor with a blue block going to and fro and a counter in the corner.
+static std::vector<cv::Mat> syntheticFrames(int width, int height)
+{
+    std::vector<cv::Mat> frames;
+    const int side = std::max(8, width/10);
+    for (int i = 0; i < SYNTHETIC_LOOP; i++)
+    {
+        cv::Mat frame(height, width, CV_8UC4, cv::Scalar(90, 90, 90, 255));
+        const int half = SYNTHETIC_LOOP/2;
+        const int step = (i < half) ? i : SYNTHETIC_LOOP - i;
+        const int x = (width - side)*step/half;
+        frame(cv::Rect(x, height/3, side, side)).setTo(cv::Scalar(200, 60, 30, 255));
+        frame(cv::Rect(0, 0, std::min(width, 8*(i % 16 + 1)), 4)).setTo(cv::Scalar(255, 255, 255, 255));
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+int32_t main(int32_t argc, char **argv) {
+    auto commandlineArguments = cluon::getCommandlineArguments(argc, argv);
+    if (0 == commandlineArguments.count("name")) {
+        std::cerr << argv[0] << " publishes frames into a shared memory area as the camera microservice does." << std::endl;
+        std::cerr << "Usage:   " << argv[0] << " --name=<name of shared memory area> [--width=<w>] [--height=<h>] [--fps=<rate>] [--frames=<source>] [--count=<n>] [--raw] [--verbose]" << std::endl;
+        std::cerr << "         --name:    name of the shared memory area to create" << std::endl;
+        std::cerr << "         --width:   width of the frames; default: 1280" << std::endl;
+        std::cerr << "         --height:  height of the frames; default: 720" << std::endl;
+        std::cerr << "         --fps:     frames per second; default: " << PRODUCER_FPS << std::endl;
+        std::cerr << "         --frames:  (optional) directory of images or video to publish, repeated; scaled to the frame size" << std::endl;
+        std::cerr << "         --count:   (optional) frames to publish before stopping; default: until interrupted" << std::endl;
+        std::cerr << "         --buffers: (optional) frame buffers in the area; default: " << SHARED_FRAME_BUFFERS << std::endl;
+        std::cerr << "         --raw:     (optional) a single raw BGRA frame overwritten in place, as the camera decoders write" << std::endl;
+        std::cerr << "         --verbose: (optional) prints the achieved rate every second" << std::endl;
+        std::cerr << "Example: " << argv[0] << " --name=img.argb --width=640 --height=480 --fps=120 --verbose" << std::endl;
+        return 1;
+    }
+
+    const std::string NAME{commandlineArguments["name"]};
+    const int WIDTH{(commandlineArguments.count("width") != 0) ? std::stoi(commandlineArguments["width"]) : 1280};
+    const int HEIGHT{(commandlineArguments.count("height") != 0) ? std::stoi(commandlineArguments["height"]) : 720};
+    const double FPS{(commandlineArguments.count("fps") != 0) ? std::stod(commandlineArguments["fps"]) : PRODUCER_FPS};
+    const uint64_t COUNT{(commandlineArguments.count("count") != 0) ? static_cast<uint64_t>(std::stoll(commandlineArguments["count"])) : 0};
+    const int BUFFERS{(commandlineArguments.count("buffers") != 0) ? std::stoi(commandlineArguments["buffers"]) : SHARED_FRAME_BUFFERS};
+    const std::string FRAMES{(commandlineArguments.count("frames") != 0) ? commandlineArguments["frames"] : ""};
+    const bool RAW{commandlineArguments.count("raw") != 0};
+    const bool VERBOSE{commandlineArguments.count("verbose") != 0};
+
+    if (FPS <= 0)
+    {
+        std::cerr << argv[0] << ": --fps must be positive." << std::endl;
+        return 1;
+    }
+    if (WIDTH <= 0 || HEIGHT <= 0)
+    {
+        std::cerr << argv[0] << ": --width and --height must be positive." << std::endl;
+        return 1;
+    }
+    if (BUFFERS <= 0)
+    {
+        std::cerr << argv[0] << ": --buffers must be positive." << std::endl;
+        return 1;
+    }
+    // the area's size is a uint32_t, header included
+    const uint64_t frameBytes{static_cast<uint64_t>(WIDTH)*static_cast<uint64_t>(HEIGHT)*4};
+    if (frameBytes*static_cast<uint64_t>(RAW ? 1 : BUFFERS) + sizeof(SharedFrameHeader) + SHARED_FRAME_ALIGNMENT > UINT32_MAX)
+    {
+        std::cerr << argv[0] << ": frames of " << WIDTH << "x" << HEIGHT << " do not fit in a shared memory area." << std::endl;
+        return 1;
+    }
+
+    const cv::Size SIZE(WIDTH, HEIGHT);
+    std::vector<cv::Mat> frames = FRAMES.empty() ? syntheticFrames(SIZE.width, SIZE.height) : loadFrames(FRAMES, PRODUCER_FRAMES, SIZE);
+    if (frames.empty())
+    {
+        std::cerr << argv[0] << ": no frames could be read from '" << FRAMES << "'." << std::endl;
+        return 1;
+    }
+
+    const uint32_t bytes = RAW ? static_cast<uint32_t>(frameBytes)
+                               : sharedFrameBytes(static_cast<uint32_t>(WIDTH), static_cast<uint32_t>(HEIGHT), static_cast<uint32_t>(BUFFERS));
+    std::unique_ptr<cluon::SharedMemory> sharedMemory{new cluon::SharedMemory{NAME, bytes}};
+    if (!sharedMemory->valid())
+    {
+        std::cerr << argv[0] << ": cannot create shared memory '" << NAME << "'." << std::endl;
+        return 1;
+    }
+    std::unique_ptr<SharedFrameWriter> writer;
+    if (!RAW)
+    {
+        writer.reset(new SharedFrameWriter(sharedMemory.get(), static_cast<uint32_t>(WIDTH), static_cast<uint32_t>(HEIGHT), static_cast<uint32_t>(BUFFERS)));
+        if (!writer->valid()) return 1;
+    }
+    std::clog << argv[0] << ": Publishing " << frames.size() << " frames of " << WIDTH << "x" << HEIGHT << " at " << FPS
+              << " fps into '" << sharedMemory->name() << "' (" << sharedMemory->size() << " bytes"
+              << (RAW ? ", raw" : "") << ")." << std::endl;
+
+    std::signal(SIGINT, onStop);
+    std::signal(SIGTERM, onStop);
+
+    // absolute deadlines, so that the rate does not drift; a producer that
+    // falls behind skips the missed deadlines instead of bursting
+    const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0/FPS));
+    auto deadline = std::chrono::steady_clock::now();
+    auto nextReport = deadline + std::chrono::seconds(REPORT_PERIOD_S);
+    uint64_t published{0}, reported{0}, late{0};
+
+    while (running && (COUNT == 0 || published < COUNT))
+    {
+        const cv::Mat &frame = frames[published % frames.size()];
+        if (RAW)
+        {
+            sharedMemory->lock();
+            std::memcpy(sharedMemory->data(), frame.data, bytes);
+            sharedMemory->unlock();
+            sharedMemory->notifyAll();
+        }
+        else
+        {
+            cv::Mat target = writer->acquire();
+            frame.copyTo(target);
+            writer->publish();
+        }
+        published++;
+
+        auto now = std::chrono::steady_clock::now();
+        if (VERBOSE && now >= nextReport)
+        {
+            std::cout << "Published " << (published - reported)/static_cast<double>(REPORT_PERIOD_S) << " fps, "
+                      << late << " deadlines missed in total" << std::endl;
+            reported = published;
+            nextReport += std::chrono::seconds(REPORT_PERIOD_S);
+        }
+
+        deadline += period;
+        if (now > deadline)
+        {
+            late += (now - deadline)/period + 1;
+            deadline = now;
+            continue;
+        }
+        std::this_thread::sleep_until(deadline);
+    }
+
+    std::clog << argv[0] << ": Published " << published << " frames, " << late << " deadlines missed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2019  Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECORDED_FRAMES_HPP_INCLUDED
+#define RECORDED_FRAMES_HPP_INCLUDED
+
+#include <opencv2/opencv.hpp>
+
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+// BGRA as the camera writes it, at `size` or else at the size of the first frame.
+inline void addFrame(std::vector<cv::Mat> &frames, const cv::Mat &image, cv::Size size)
+{
+    if (image.empty()) return;
+    cv::Mat bgra;
+    if (image.channels() == 4) bgra = image.clone();
+    else if (image.channels() == 3) cv::cvtColor(image, bgra, cv::COLOR_BGR2BGRA);
+    else cv::cvtColor(image, bgra, cv::COLOR_GRAY2BGRA);
+    if (size.area() == 0 && !frames.empty()) size = frames.front().size();
+    if (size.area() != 0 && bgra.size() != size) cv::resize(bgra, bgra, size);
+    frames.push_back(bgra);
+}
+
+// Up to `count` frames from a directory of images, in name order, or a video.
+inline std::vector<cv::Mat> loadFrames(const std::string &path, size_t count, cv::Size size = cv::Size())
+{
+    std::vector<cv::Mat> frames;
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode))
+    {
+        std::vector<std::string> files;
+        cv::glob(path, files); // sorted by name
+        for (size_t i = 0; i < files.size() && frames.size() < count; i++)
+            addFrame(frames, cv::imread(files[i], cv::IMREAD_UNCHANGED), size);
+    }
+    else
+    {
+        cv::VideoCapture video(path);
+        cv::Mat image;
+        while (frames.size() < count && video.isOpened() && video.read(image)) addFrame(frames, image, size);
+    }
+    return frames;
+}
+
+#endif // RECORDED_FRAMES_HPP_INCLUDED
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2019  Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "catch.hpp"
+
+#include "action-output.hpp"
+
+#include <sstream>
+
+static ActionOutput::Time at(int ms)
+{
+    return ActionOutput::Time() + std::chrono::hours(1) + std::chrono::milliseconds(ms);
+}
+
+TEST_CASE("Test an unchanged action is only repeated at the refresh rate") {
+    ActionOutput output(50, 500);
+    REQUIRE(output.offer(1, 0, at(0)));
+    for (int ms = 33; ms < 500; ms += 33) REQUIRE(!output.offer(1, 0, at(ms)));
+    REQUIRE(output.offer(1, 0, at(500)));
+    REQUIRE(2 == output.messages());
+    REQUIRE(15 == output.coalesced());
+}
+
+TEST_CASE("Test changes are sent at most once per period") {
+    ActionOutput output(50, 500);
+    REQUIRE(output.offer(1, 0, at(0)));
+    REQUIRE(output.offer(2, 0, at(60)));
+
+    // changes within the period wait; the latest one is sent when it is over
+    REQUIRE(!output.offer(1, 0, at(70)));
+    REQUIRE(!output.offer(10, 0, at(90)));
+    REQUIRE(output.offer(13, 0.4f, at(110)));
+
+    // a change that is undone within the period is never sent
+    REQUIRE(!output.offer(10, 0.4f, at(120)));
+    REQUIRE(!output.offer(13, 0.4f, at(170)));
+
+    // angles move in steps of ACTION_ANGLE_STEP
+    REQUIRE(!output.offer(13, 0.405f, at(200)));
+    REQUIRE(output.offer(13, 0.42f, at(210)));
+    REQUIRE(4 == output.messages());
+    REQUIRE(5 == output.coalesced());
+}
+
+TEST_CASE("Test the report gives the rate since the last one") {
+    ActionOutput output(50, 500);
+    for (int ms = 0; ms <= 1000; ms += 100) {
+        if (output.offer(static_cast<uint16_t>(ms/100), 0, at(ms))) output.sent(40);
+    }
+    REQUIRE(11 == output.messages());
+    REQUIRE(440 == output.bytes());
+
+    std::ostringstream out;
+    output.report(out, at(1000));
+    REQUIRE(out.str().find("11 msg/s, 440 B/s") != std::string::npos);
+}
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2019  Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include "counting-allocator.hpp"
+#include "kiwi-image-processing.hpp"
+
+/* A 640x480 frame with the reference region filled with the given colour. */
+static cv::Mat frame(cv::Scalar region)
+{
+    cv::Mat mat(480, 640, CV_8UC4, cv::Scalar(90, 120, 150, 255));
+    mat(cv::Rect(c_1, c_2)) = region;
+    for (int x = 0; x < mat.cols; ++x) mat.at<cv::Vec4b>(0, x)[0] = static_cast<uchar>(x % 256);
+    return mat;
+}
+
+static bool equal(const cv::Mat &a, const cv::Mat &b)
+{
+    if (a.size() != b.size() || a.type() != b.type()) return false;
+    for (int y = 0; y < a.rows; ++y)
+        if (memcmp(a.ptr<uchar>(y), b.ptr<uchar>(y), a.cols * a.elemSize()) != 0) return false;
+    return true;
+}
+
+TEST_CASE("Test normalization reaches the caller") {
+    const cv::Mat in = frame(cv::Scalar(GOAL_B + 30, GOAL_G - 20, GOAL_R + 10, 255));
+    const cv::Mat original = in.clone();
+    cv::Mat out;
+
+    normalize_t(in, out);
+    REQUIRE(in.size() == out.size());
+    REQUIRE(in.type() == out.type());
+    REQUIRE(equal(in, original));
+    REQUIRE(!equal(in, out));
+
+    // Bluer than the goal: blue goes down, green up; alpha is untouched.
+    const cv::Vec4b before = in.at<cv::Vec4b>(100, 100);
+    const cv::Vec4b after = out.at<cv::Vec4b>(100, 100);
+    REQUIRE(after[0] < before[0]);
+    REQUIRE(after[1] > before[1]);
+    REQUIRE(after[3] == before[3]);
+
+    cv::Mat mat = in.clone();
+    normalize_t(mat, mat);
+    REQUIRE(equal(mat, out));
+}
+
+TEST_CASE("Test dark frames are brightened") {
+    const cv::Mat in = frame(cv::Scalar(20, 20, 20, 255));
+    cv::Mat out, expected;
+
+    normalize_t(in, out);
+    REQUIRE(out.at<cv::Vec4b>(c_1.y + 1, c_1.x + 1)[2] > 20);
+    cv::LUT(in, normalization_frame_lut(in), expected);
+    REQUIRE(equal(out, expected));
+}
+
+TEST_CASE("Test composed tables") {
+    const cv::Mat first = brightness_lut(4);
+    const cv::Mat second = normalization_lut(cv::Scalar(12, -8, 20), 0.9f, 4);
+    cv::Mat fused = first.clone();
+    compose_lut(fused, second);
+
+    const cv::Mat in = frame(cv::Scalar(50, 100, 150, 255));
+    cv::Mat once, twice;
+    cv::LUT(in, fused, once);
+    cv::LUT(in, first, twice);
+    cv::LUT(twice, second, twice);
+    REQUIRE(equal(once, twice));
+}
+
+TEST_CASE("Test Normalizer matches the uncached table") {
+    const cv::Mat in = frame(cv::Scalar(GOAL_B + 30, GOAL_G - 20, GOAL_R + 10, 255));
+    cv::Mat out, expected;
+    Normalizer normalizer(10);
+
+    normalizer.apply(in, out);
+    REQUIRE(normalizer.refreshed());
+    cv::LUT(in, normalization_frame_lut(in), expected);
+    REQUIRE(equal(out, expected));
+
+    normalizer.apply(in, out);
+    REQUIRE(!normalizer.refreshed());
+    REQUIRE(equal(out, expected));
+
+    // A lighting change is picked up before the period runs out.
+    const cv::Mat brighter = frame(cv::Scalar(GOAL_B + 60, GOAL_G, GOAL_R + 40, 255));
+    normalizer.apply(brighter, out);
+    REQUIRE(normalizer.refreshed());
+}
+
+TEST_CASE("Test normalization does not allocate per frame") {
+    const cv::Mat in = frame(cv::Scalar(GOAL_B + 30, GOAL_G - 20, GOAL_R + 10, 255));
+    const cv::Mat dark = frame(cv::Scalar(20, 20, 20, 255));
+    cv::Mat out;
+    Normalizer cached(NORMALIZE_PERIOD);
+    Normalizer refreshing(1);
+    cached.apply(in, out);
+    refreshing.apply(dark, out);
+
+    CountingAllocator counter;
+    for (int i = 0; i < 10; i++) {
+        cached.apply(in, out);
+        refreshing.apply(dark, out);
+    }
+    REQUIRE(0 == counter.allocations);
+
+    cv::Mat mat = in.clone();
+    counter.allocations = 0;
+    cached.apply(mat);
+    REQUIRE(0 == counter.allocations);
+}
+
+TEST_CASE("Test HsvRange matches cvtColor and inRange") {
+    cv::Mat in(64, 256, CV_8UC4);
+    for (int y = 0; y < in.rows; ++y)
+        for (int x = 0; x < in.cols; ++x)
+            in.at<cv::Vec4b>(y, x) = cv::Vec4b(static_cast<uchar>(x), static_cast<uchar>((x*7 + y*29) % 256),
+                                               static_cast<uchar>((y*37 + x*3) % 256), 255);
+    cv::Mat hsv, expected, mask;
+    cv::cvtColor(in, hsv, cv::COLOR_BGRA2BGR);
+    cv::cvtColor(hsv, hsv, cv::COLOR_BGR2HSV);
+
+    const cv::Scalar ranges[][2] = {
+        {cv::Scalar(100, 150, 150), cv::Scalar(130, 200, 200)},
+        {cv::Scalar(-255, 0, -255), cv::Scalar(255, 30, 255)},   // grey
+        {cv::Scalar(-250, -250, 190), cv::Scalar(260, 260, 270)}, // white
+        {cv::Scalar(-10, 40, 40), cv::Scalar(20, 255, 255)}};
+    HsvRange range;
+    for (const cv::Scalar *r : ranges) {
+        cv::inRange(hsv, r[0], r[1], expected);
+        range.set(r[0], r[1]);
+        range.apply(in, mask);
+        REQUIRE(equal(mask, expected));
+    }
+}
+
+TEST_CASE("Test meanHsv matches cvtColor and mean") {
+    cv::Mat in(64, 256, CV_8UC4);
+    for (int y = 0; y < in.rows; ++y)
+        for (int x = 0; x < in.cols; ++x)
+            in.at<cv::Vec4b>(y, x) = cv::Vec4b(static_cast<uchar>(x), static_cast<uchar>((x*7 + y*29) % 256),
+                                               static_cast<uchar>((y*37 + x*3) % 256), 255);
+    cv::Mat hsv;
+    cv::cvtColor(in, hsv, cv::COLOR_BGRA2BGR);
+    cv::cvtColor(hsv, hsv, cv::COLOR_BGR2HSV);
+
+    const cv::Rect areas[] = {cv::Rect(0, 0, 8, 8), cv::Rect(100, 20, 8, 8), cv::Rect(3, 5, 200, 50),
+                              cv::Rect(0, 0, 256, 64), cv::Rect(255, 63, 1, 1)};
+    for (const cv::Rect &area : areas) {
+        const cv::Scalar expected = cv::mean(hsv(area));
+        const cv::Scalar actual = meanHsv(in, area);
+        for (int c = 0; c < 3; ++c)
+            REQUIRE(Approx(expected[c]) == actual[c]);
+    }
+
+    // areas reaching past the frame are clipped to it
+    REQUIRE(meanHsv(in, cv::Rect(255, 63, 1, 1)) == meanHsv(in, cv::Rect(255, 63, 8, 8)));
+    REQUIRE(cv::Scalar() == meanHsv(in, cv::Rect(300, 0, 8, 8)));
+}
+
+TEST_CASE("Test cleanMask opens the mask in place of the caller") {
+    cv::Mat mask(100, 120, CV_8UC1, cv::Scalar(0));
+    mask(cv::Rect(20, 30, 40, 40)).setTo(cv::Scalar(255));
+    mask(cv::Rect(90, 10, 3, 3)).setTo(cv::Scalar(255)); // a speck
+
+    cv::Mat expected(100, 120, CV_8UC1, cv::Scalar(0));
+    expected(cv::Rect(20, 30, 40, 40)).setTo(cv::Scalar(255));
+
+    cv::Mat out;
+    cleanMask(mask, out);
+    REQUIRE(equal(out, expected));
+    REQUIRE(equal(cleanMask(mask), expected));
+
+    const uchar* buffer = out.data;
+    cleanMask(mask, out);
+    REQUIRE(buffer == out.data);
+}
+
+TEST_CASE("Test the marker border is drawn around a view that resizes in place") {
+    cv::Mat background = create_border_image(320, 240);
+    REQUIRE(320 + 2*MARKER_SIZE == background.cols);
+    REQUIRE(240 == background.rows);
+
+    const cv::Vec4b black(0, 0, 0, 255), white(255, 255, 255, 255), grey(200, 200, 200, 0);
+    REQUIRE(black == background.at<cv::Vec4b>(0, 0));
+    REQUIRE(white == background.at<cv::Vec4b>(30, 50));  // marker 1, cell (1,2)
+    REQUIRE(white == background.at<cv::Vec4b>(70, 30));  // marker 1, cell (3,1)
+    REQUIRE(white == background.at<cv::Vec4b>(240 - MARKER_SIZE + 50, 30));  // marker 2, cell (2,1)
+    REQUIRE(white == background.at<cv::Vec4b>(70, 320 + MARKER_SIZE + 50));  // marker 3, cell (3,2)
+    REQUIRE(white == background.at<cv::Vec4b>(239 - 30, 320 + MARKER_SIZE + 70)); // marker 4, cell (3,3)
+    REQUIRE(black == background.at<cv::Vec4b>(239, 319 + 2*MARKER_SIZE));
+    REQUIRE(grey == background.at<cv::Vec4b>(120, 50));
+
+    cv::Mat view = background(cv::Rect(MARKER_SIZE, 0, 320, 240));
+    cv::Mat frame(240, 320, CV_8UC4, cv::Scalar(10, 20, 30, 255));
+    frame.copyTo(view);
+    REQUIRE(view.data == background.ptr(0) + MARKER_SIZE*4);
+    REQUIRE(cv::Vec4b(10, 20, 30, 255) == background.at<cv::Vec4b>(120, MARKER_SIZE));
+    REQUIRE(black == background.at<cv::Vec4b>(0, 0));
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2019  Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "catch.hpp"
+
+#include "seqlock.hpp"
+
+#include <cstdint>
+#include <thread>
+
+struct Reading
+{
+    uint32_t first;
+    uint16_t x;
+    uint16_t y;
+    double value;
+    uint32_t last;
+};
+
+TEST_CASE("Test seqlock stores and updates") {
+    Seqlock<Reading> latest;
+    REQUIRE(0 == latest.version());
+    REQUIRE(0 == latest.load().x);
+
+    latest.store(Reading{1, 10, 20, 0.5, 1});
+    REQUIRE(1 == latest.version());
+    REQUIRE(10 == latest.load().x);
+
+    latest.update([](Reading &r){ r.y = 30; });
+    Reading r = latest.load();
+    REQUIRE(2 == latest.version());
+    REQUIRE(10 == r.x);
+    REQUIRE(30 == r.y);
+    REQUIRE(Approx(0.5) == r.value);
+}
+
+TEST_CASE("Test seqlock readers never see half a write") {
+    Seqlock<Reading> latest;
+    const uint32_t COUNT{200000};
+
+    std::thread writer([&](){
+        for (uint32_t i = 1; i <= COUNT; i++)
+            latest.store(Reading{i, static_cast<uint16_t>(i), static_cast<uint16_t>(i >> 16), i*0.5, i});
+    });
+
+    bool consistent{true};
+    bool ordered{true};
+    uint32_t previous{0};
+    while (previous < COUNT) {
+        Reading r = latest.load();
+        consistent = consistent && r.first == r.last && r.x == static_cast<uint16_t>(r.first)
+                     && r.value == r.first*0.5;
+        ordered = ordered && r.first >= previous;
+        previous = r.first;
+    }
+    writer.join();
+
+    REQUIRE(consistent);
+    REQUIRE(ordered);
+    REQUIRE(COUNT == latest.version());
+}
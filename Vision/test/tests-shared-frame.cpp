@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2019  Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "catch.hpp"
+
+#include "shared-frame.hpp"
+
+#include <unistd.h>
+
+static std::string areaName(const std::string &test)
+{
+    return "/tests-shared-frame-" + test + "-" + std::to_string(getpid());
+}
+
+TEST_CASE("Test frames are handed over in place") {
+    cluon::SharedMemory memory(areaName("handover"), sharedFrameBytes(64, 48));
+    REQUIRE(memory.valid());
+
+    SharedFrameWriter writer(&memory, 64, 48);
+    REQUIRE(writer.valid());
+    SharedFrameReader reader(&memory);
+    REQUIRE(reader.valid());
+    REQUIRE(reader.zeroCopy());
+    REQUIRE(cv::Size(64, 48) == reader.size());
+
+    cv::Mat frame;
+    REQUIRE(!reader.acquire(frame));
+
+    writer.acquire() = cv::Scalar(1, 1, 1, 1);
+    writer.publish();
+    REQUIRE(reader.acquire(frame));
+    REQUIRE(1 == frame.at<cv::Vec4b>(10, 10)[0]);
+    REQUIRE(!reader.acquire(frame));
+
+    // The producer never writes to the frame being read.
+    writer.acquire() = cv::Scalar(2, 2, 2, 2);
+    writer.publish();
+    writer.acquire() = cv::Scalar(3, 3, 3, 3);
+    writer.publish();
+    REQUIRE(1 == frame.at<cv::Vec4b>(10, 10)[0]);
+
+    REQUIRE(reader.acquire(frame));
+    REQUIRE(3 == frame.at<cv::Vec4b>(10, 10)[0]);
+    REQUIRE(3 == reader.sequence());
+    REQUIRE(1 == reader.dropped());
+
+    // a caller's buffer is left alone when the frame is read in place
+    cv::Mat buffer;
+    writer.acquire() = cv::Scalar(4, 4, 4, 4);
+    writer.publish();
+    REQUIRE(reader.acquire(frame, buffer));
+    REQUIRE(4 == frame.at<cv::Vec4b>(10, 10)[0]);
+    REQUIRE(buffer.empty());
+}
+
+TEST_CASE("Test double buffering withdraws an unread frame") {
+    cluon::SharedMemory memory(areaName("double"), sharedFrameBytes(32, 24, 2));
+    SharedFrameWriter writer(&memory, 32, 24, 2);
+    SharedFrameReader reader(&memory);
+    cv::Mat frame;
+
+    writer.acquire() = cv::Scalar(1, 1, 1, 1);
+    writer.publish();
+    REQUIRE(reader.acquire(frame));
+
+    writer.acquire() = cv::Scalar(2, 2, 2, 2);
+    writer.publish();
+    cv::Mat next = writer.acquire(); // only the unread frame 2 is free
+    REQUIRE(!reader.acquire(frame));
+    REQUIRE(1 == frame.at<cv::Vec4b>(0, 0)[0]);
+
+    next = cv::Scalar(3, 3, 3, 3);
+    writer.publish();
+    REQUIRE(reader.acquire(frame));
+    REQUIRE(3 == frame.at<cv::Vec4b>(0, 0)[0]);
+}
+
+TEST_CASE("Test raw frames are copied out") {
+    cluon::SharedMemory memory(areaName("raw"), 640*480*4);
+    REQUIRE(memory.valid());
+    cv::Mat(480, 640, CV_8UC4, memory.data()) = cv::Scalar(7, 8, 9, 255);
+
+    SharedFrameReader reader(&memory);
+    REQUIRE(reader.valid());
+    REQUIRE(!reader.zeroCopy());
+    REQUIRE(cv::Size(640, 480) == reader.size());
+
+    cv::Mat frame;
+    REQUIRE(reader.acquire(frame));
+    REQUIRE(reinterpret_cast<char*>(frame.data) != memory.data());
+    REQUIRE(9 == frame.at<cv::Vec4b>(479, 639)[2]);
+
+    // into the caller's buffer, which keeps its allocation
+    cv::Mat buffer(480, 640, CV_8UC4);
+    const uchar* data = buffer.data;
+    REQUIRE(reader.acquire(frame, buffer));
+    REQUIRE(data == buffer.data);
+    REQUIRE(data == frame.data);
+    REQUIRE(8 == buffer.at<cv::Vec4b>(0, 0)[1]);
+}
+
+TEST_CASE("Test unknown raw sizes are rejected") {
+    cluon::SharedMemory memory(areaName("odd"), 1000);
+    SharedFrameReader reader(&memory);
+    REQUIRE(!reader.valid());
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2019  Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "catch.hpp"
+
+#include "spsc-queue.hpp"
+
+#include <thread>
+
+TEST_CASE("Test queue bounds and order") {
+    SpscQueue<int, 3> queue;
+    int item{0};
+    REQUIRE(queue.empty());
+    REQUIRE(!queue.pop(item));
+
+    REQUIRE(queue.push(1));
+    REQUIRE(queue.push(2));
+    REQUIRE(queue.push(3));
+    REQUIRE(!queue.push(4));
+
+    for (int round = 0; round < 10; round++) { // wraps around several times
+        REQUIRE(queue.pop(item));
+        REQUIRE(round + 1 == item);
+        REQUIRE(queue.push(round + 4));
+    }
+    REQUIRE(!queue.empty());
+}
+
+TEST_CASE("Test queue between two threads") {
+    SpscQueue<uint32_t, 8> queue;
+    const uint32_t COUNT{100000};
+
+    std::thread producer([&](){
+        for (uint32_t i = 1; i <= COUNT; i++)
+            while (!queue.push(i)) std::this_thread::yield();
+    });
+
+    uint32_t expected{1};
+    bool ordered{true};
+    while (expected <= COUNT) {
+        uint32_t item;
+        if (!queue.pop(item)) continue;
+        ordered = ordered && (item == expected);
+        expected++;
+    }
+    producer.join();
+
+    REQUIRE(ordered);
+    REQUIRE(queue.empty());
+}
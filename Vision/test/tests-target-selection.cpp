@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2019  Kamila Kowalska
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "catch.hpp"
+
+#include "target-selection.hpp"
+
+#define SCENE_WIDTH 320
+#define SCENE_HEIGHT 240
+
+static const cv::Scalar FLOOR(90, 90, 90, 255);
+static const cv::Scalar TARGET(200, 60, 30, 255);
+
+// Grey scene with a 40x40 target at `at`; `at` outside the frame leaves it out.
+static void scene(cv::Mat &frame, cv::Point at)
+{
+    frame.create(SCENE_HEIGHT, SCENE_WIDTH, CV_8UC4);
+    frame.setTo(FLOOR);
+    cv::Rect block = cv::Rect(at.x, at.y, 40, 40) & cv::Rect(0, 0, SCENE_WIDTH, SCENE_HEIGHT);
+    if (!block.empty()) frame(block).setTo(TARGET);
+}
+
+static cv::Scalar targetHsv()
+{
+    cv::Mat pixel(1, 1, CV_8UC3, TARGET), hsv;
+    cv::cvtColor(pixel, hsv, cv::COLOR_BGR2HSV);
+    return cv::Scalar(hsv.at<cv::Vec3b>(0, 0)[0], hsv.at<cv::Vec3b>(0, 0)[1], hsv.at<cv::Vec3b>(0, 0)[2]);
+}
+
+TEST_CASE("Test the predicted region follows the motion") {
+    const cv::Rect bounds(0, 0, SCENE_WIDTH, T_BELOW(SCENE_HEIGHT));
+
+    cv::Rect roi = predictRoi(cv::Rect(100, 50, 40, 20), cv::Point(10, -4), bounds);
+    REQUIRE(cv::Rect(64, 16, 132, 80) == roi);
+
+    roi = predictRoi(cv::Rect(0, 0, 40, 20), cv::Point(0, 0), bounds);
+    REQUIRE(cv::Rect(0, 0, 76, 46) == roi);
+
+    roi = predictRoi(cv::Rect(1000, 1000, 40, 20), cv::Point(0, 0), bounds);
+    REQUIRE(roi.empty());
+}
+
+TEST_CASE("Test the zone map matches the gaze bands") {
+    const ZoneMap zones(SCENE_WIDTH, SCENE_HEIGHT);
+    for (int y = 0; y < SCENE_HEIGHT; y += 3) {
+        for (int x = 0; x < SCENE_WIDTH; x += 3) {
+            uint8_t expected = ZONE_TARGET;
+            if (y < T_ABOVE(SCENE_HEIGHT)) expected = ZONE_ABOVE;
+            else if (y > T_BELOW(SCENE_HEIGHT)) expected = ZONE_BELOW;
+            else if (x < T_LEFT(SCENE_WIDTH)) expected = ZONE_LEFT;
+            else if (x > T_RIGHT(SCENE_WIDTH)) expected = ZONE_RIGHT;
+            REQUIRE(expected == zones.at(x, y));
+        }
+    }
+    REQUIRE(ZONE_RIGHT == zones.at(SCENE_WIDTH + 50, SCENE_HEIGHT/2));
+    REQUIRE(ZONE_BELOW == zones.at(SCENE_WIDTH/2, SCENE_HEIGHT));
+}
+
+TEST_CASE("Test a gaze in a band chooses its action") {
+    Args p(MODE_TARGET, false, false, false, SCENE_WIDTH, SCENE_HEIGHT);
+    scene(p.frame, cv::Point(60, 50));
+    p.active = true;
+    p.fixation = true;
+
+    p.x = 5;
+    p.y = SCENE_HEIGHT/2;
+    findAction(&p);
+    REQUIRE(LEFT_TURN == p.action);
+
+    p.x = SCENE_WIDTH - 5;
+    findAction(&p);
+    REQUIRE(RIGHT_TURN == p.action);
+
+    p.x = SCENE_WIDTH/2;
+    p.y = 2;
+    findAction(&p);
+    REQUIRE(MOVE_BACKWARDS == p.action);
+}
+
+TEST_CASE("Test a followed target is searched for around its last position") {
+    Args p(MODE_TARGET, false, false, false, SCENE_WIDTH, SCENE_HEIGHT);
+    const cv::Rect selection(0, 0, SCENE_WIDTH, T_BELOW(SCENE_HEIGHT));
+    p.hsv_scalar = targetHsv();
+
+    scene(p.frame, cv::Point(60, 50));
+    p.x = 80;
+    p.y = 70;
+    findObject(&p);
+    REQUIRE(FOLLOWING == p.SELECTION_MODE);
+    REQUIRE(cv::Rect(60, 50, 40, 40) == p.t);
+    REQUIRE(selection == p.roi);
+
+    for (int step = 1; step <= 4; step++) {
+        scene(p.frame, cv::Point(60 + 8*step, 50 + 2*step));
+        findObject(&p);
+        REQUIRE(FOLLOWING == p.SELECTION_MODE);
+        REQUIRE(cv::Rect(60 + 8*step, 50 + 2*step, 40, 40) == p.t);
+        REQUIRE(p.roi.area() < selection.area()/3);
+    }
+    REQUIRE(p.track.velocity().x > 0);
+    REQUIRE(p.track.predicted().x > p.t.x);
+
+    // a block far from the prediction is not taken for the target, which
+    // is carried over a few frames before it is given up
+    scene(p.frame, cv::Point(220, 100));
+    for (int frame = 0; frame < TRACK_COAST; frame++) {
+        findObject(&p);
+        REQUIRE(FOLLOWING == p.SELECTION_MODE);
+        REQUIRE(selection == p.roi);
+        REQUIRE(p.t.x < 200);
+    }
+    findObject(&p);
+    REQUIRE(FIND_NEW == p.SELECTION_MODE);
+}
+
+TEST_CASE("Test a target that reappears is picked up again") {
+    Args p(MODE_TARGET, false, false, false, SCENE_WIDTH, SCENE_HEIGHT);
+    p.hsv_scalar = targetHsv();
+
+    scene(p.frame, cv::Point(60, 50));
+    p.x = 80;
+    p.y = 70;
+    findObject(&p);
+    REQUIRE(FOLLOWING == p.SELECTION_MODE);
+
+    scene(p.frame, cv::Point(-100, -100));
+    findObject(&p);
+    findObject(&p);
+    REQUIRE(FOLLOWING == p.SELECTION_MODE);
+
+    scene(p.frame, cv::Point(64, 50));
+    findObject(&p);
+    REQUIRE(FOLLOWING == p.SELECTION_MODE);
+    REQUIRE(cv::Rect(64, 50, 40, 40) == p.t);
+}
+
+TEST_CASE("Test a larger look-alike does not take over the track") {
+    Args p(MODE_TARGET, false, false, false, SCENE_WIDTH, SCENE_HEIGHT);
+    p.hsv_scalar = targetHsv();
+
+    scene(p.frame, cv::Point(60, 50));
+    p.x = 80;
+    p.y = 70;
+    findObject(&p);
+    REQUIRE(FOLLOWING == p.SELECTION_MODE);
+
+    scene(p.frame, cv::Point(62, 50));
+    p.frame(cv::Rect(130, 40, 60, 60)).setTo(TARGET);
+    findObject(&p);
+    REQUIRE(FOLLOWING == p.SELECTION_MODE);
+    REQUIRE(cv::Rect(62, 50, 40, 40) == p.t);
+}
+
+TEST_CASE("Test a selection off the target is discarded") {
+    Args p(MODE_TARGET, false, false, false, SCENE_WIDTH, SCENE_HEIGHT);
+    p.hsv_scalar = targetHsv();
+    scene(p.frame, cv::Point(60, 50));
+
+    p.x = 200;
+    p.y = 70;
+    findObject(&p);
+    REQUIRE(FIND_NEW == p.SELECTION_MODE);
+
+    p.x = 80;
+    p.y = T_BELOW(SCENE_HEIGHT); // just below the searched region
+    findObject(&p);
+    REQUIRE(FIND_NEW == p.SELECTION_MODE);
+}
+
+TEST_CASE("Test blobs are measured in frame pixels") {
+    Args p(MODE_TARGET, false, false, false, SCENE_WIDTH, SCENE_HEIGHT);
+    cv::Mat mask(80, 100, CV_8UC1, cv::Scalar(0));
+    mask(cv::Rect(10, 10, 20, 10)).setTo(cv::Scalar(255));
+    mask(cv::Rect(50, 40, 5, 5)).setTo(cv::Scalar(255));
+
+    findBlobs(&p, mask, cv::Point(100, 50), 30);
+    REQUIRE(1 == p.blobs.size());
+    REQUIRE(cv::Rect(110, 60, 20, 10) == p.blobs[0].box);
+    REQUIRE(200 == p.blobs[0].area);
+    REQUIRE(Approx(119.5) == p.blobs[0].centroid.x);
+    REQUIRE(Approx(64.5) == p.blobs[0].centroid.y);
+}
+
+TEST_CASE("Test the target nearest to the selection is chosen") {
+    Args p(MODE_TARGET, false, false, false, SCENE_WIDTH, SCENE_HEIGHT);
+    p.hsv_scalar = targetHsv();
+    scene(p.frame, cv::Point(60, 50));
+    p.frame(cv::Rect(200, 80, 50, 50)).setTo(TARGET);
+
+    p.x = 225;
+    p.y = 100;
+    findObject(&p);
+    REQUIRE(FOLLOWING == p.SELECTION_MODE);
+    REQUIRE(cv::Rect(200, 80, 50, 50) == p.t);
+    REQUIRE(2 == p.blobs.size());
+}
+
+TEST_CASE("Test a glance back at a tracked target selects it again") {
+    const cv::Scalar OTHER(40, 180, 60, 255);
+    Args p(MODE_TARGET, false, false, false, SCENE_WIDTH, SCENE_HEIGHT);
+    p.active = true;
+
+    scene(p.frame, cv::Point(60, 50));
+    p.frame(cv::Rect(200, 80, 40, 40)).setTo(OTHER);
+    p.fixation = true;
+    p.x = 80;
+    p.y = 70;
+    findAction(&p);
+    updateTargets(&p);
+    REQUIRE(FOLLOWING == p.SELECTION_MODE);
+    const int first = p.selected;
+    REQUIRE(first >= 0);
+
+    p.x = 220;
+    p.y = 100;
+    findAction(&p);
+    updateTargets(&p);
+    REQUIRE(FOLLOWING == p.SELECTION_MODE);
+    REQUIRE(cv::Rect(200, 80, 40, 40) == p.t);
+    REQUIRE(first != p.selected);
+    REQUIRE(p.targets.id[first] != p.targets.id[p.selected]);
+
+    // the first target moves while the other one is followed
+    p.fixation = false;
+    for (int step = 1; step <= 3; step++) {
+        scene(p.frame, cv::Point(60 + 6*step, 50));
+        p.frame(cv::Rect(200, 80, 40, 40)).setTo(OTHER);
+        findAction(&p);
+        updateTargets(&p);
+        REQUIRE(cv::Rect(200, 80, 40, 40) == p.t);
+        REQUIRE(cv::Rect(60 + 6*step, 50, 40, 40) == p.targets.box[first]);
+    }
+
+    p.fixation = true;
+    p.x = 98;
+    p.y = 70;
+    findAction(&p);
+    updateTargets(&p);
+    REQUIRE(first == p.selected);
+    REQUIRE(FOLLOWING == p.SELECTION_MODE);
+    REQUIRE(cv::Rect(78, 50, 40, 40) == p.t);
+    REQUIRE(p.targets.colour[first] == p.hsv_scalar);
+}